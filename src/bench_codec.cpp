@@ -0,0 +1,662 @@
+#include "codec.h"
+#include <bitset>
+#include <chrono>
+#include <iostream>
+#include <print>
+
+// The string-based packer and tree-walking parser the codec used before
+// BitWriter/BitReader and HuffmanDecoder, kept here so the benchmark can report
+// before/after throughput on the same frames.
+namespace legacy {
+
+inline unsigned char stringToByte(const std::string& bits, int start) {
+    unsigned char byte = 0;
+    for (int i = 0; i < 8; i++) {
+        if (start + i >= static_cast<int>(bits.length())) {
+            break;
+        }
+        if (bits[start + i] == '1') {
+            byte |= 0b10000000 >> i;
+        }
+    }
+    return byte;
+}
+
+inline std::string byteToString(unsigned char byte) {
+    std::string bits;
+    bits.reserve(8);
+    for (int i = 7; i >= 0; i--) {
+        bits += ((byte >> i) & 1) ? '1' : '0';
+    }
+    return bits;
+}
+
+// Cell layout before the packed Cell type
+using rgb = std::array<unsigned int, 3>;
+using Frame = std::vector<std::pair<char, rgb>>;
+
+inline Frame toLegacyFrame(ASCIIFrameView frame) {
+    Frame legacyFrame;
+    legacyFrame.reserve(frame.size());
+    for (const Cell& cell : frame.cells) {
+        legacyFrame.push_back({cell.glyph, rgb{cell.r, cell.g, cell.b}});
+    }
+    return legacyFrame;
+}
+
+inline std::vector<std::uint8_t> pack(const Frame& frame, const HuffmanCodeTable& codes) {
+    std::string bitString;
+    for (const auto& [ch, color] : frame) {
+        const HuffmanCode& code = codes[static_cast<unsigned char>(ch)];
+        bitString.append(std::bitset<8>(code.length).to_string());
+        bitString.append(std::bitset<64>(code.bits).to_string().substr(64 - code.length));
+        bitString.append(std::bitset<8>(color[0]).to_string());
+        bitString.append(std::bitset<8>(color[1]).to_string());
+        bitString.append(std::bitset<8>(color[2]).to_string());
+    }
+    std::vector<std::uint8_t> bytes;
+    for (int i = 0; i < static_cast<int>(bitString.length()); i += 8) {
+        bytes.push_back(stringToByte(bitString, i));
+    }
+    return bytes;
+}
+
+inline char findCharFromCode(Node* root, const std::string& code) {
+    if (!root->l && !root->r) {
+        return root->character;
+    }
+    Node* current = root;
+    for (char bit : code) {
+        current = bit == '0' ? current->l : current->r;
+    }
+    return current->character;
+}
+
+inline std::size_t unpack(const std::vector<std::uint8_t>& bytes, std::size_t cells, Node* huffmanTree) {
+    std::string bits;
+    for (std::uint8_t byte : bytes) {
+        bits += byteToString(byte);
+    }
+    std::size_t checksum = 0;
+    int start = 0;
+    for (std::size_t c = 0; c < cells; ++c) {
+        const int codeLen = std::stoi(bits.substr(start, 8), nullptr, 2);
+        start += 8;
+        checksum += static_cast<unsigned char>(findCharFromCode(huffmanTree, bits.substr(start, codeLen)));
+        start += codeLen;
+        for (int channel = 0; channel < 3; ++channel) {
+            checksum += std::stoi(bits.substr(start, 8), nullptr, 2);
+            start += 8;
+        }
+    }
+    return checksum;
+}
+
+} // namespace legacy
+
+static ASCIIVideo makeSyntheticVideo(int numFrames, int columns, int rows) {
+    const std::string gradient = "@%#*+=-:. ";
+    ASCIIVideo video(columns, rows);
+    video.reserve(numFrames);
+    for (int f = 0; f < numFrames; ++f) {
+        ASCIIFrame frame(columns, rows);
+        for (int y = 0; y < rows; ++y) {
+            for (int x = 0; x < columns; ++x) {
+                const int shade = (x + y + f / 4) % static_cast<int>(gradient.size());
+                frame.at(x, y) = {
+                    gradient[shade],
+                    static_cast<std::uint8_t>((x * 3 + f) % 256),
+                    static_cast<std::uint8_t>((y * 5) % 256),
+                    static_cast<std::uint8_t>((x + y + f / 8) % 256)};
+            }
+        }
+        video.push_back(frame);
+    }
+    return video;
+}
+
+// A static background with a block of text moving across it, so delta frames
+// change a few short runs of cells per row
+static ASCIIVideo makeMovingBlockVideo(int numFrames, int columns, int rows) {
+    const std::string gradient = "@%#*+=-:. ";
+    ASCIIVideo video(columns, rows);
+    video.reserve(numFrames);
+    for (int f = 0; f < numFrames; ++f) {
+        ASCIIFrame frame(columns, rows);
+        for (int y = 0; y < rows; ++y) {
+            for (int x = 0; x < columns; ++x) {
+                const bool inBlock = x >= f && x < f + 40 && y >= 20 && y < 35;
+                frame.at(x, y) = inBlock
+                    ? Cell{gradient[(x - f) % gradient.size()], 255, 255, 255}
+                    : Cell{gradient[(x * y) % gradient.size()], static_cast<std::uint8_t>(x), static_cast<std::uint8_t>(y), 64};
+            }
+        }
+        video.push_back(frame);
+    }
+    return video;
+}
+
+// A camera panning over a textured scene, two cells right per frame and one
+// down every fourth
+static ASCIIVideo makePanningVideo(int numFrames, int columns, int rows) {
+    const std::string gradient = "@%#*+=-:. ";
+    ASCIIVideo video(columns, rows);
+    video.reserve(numFrames);
+    for (int f = 0; f < numFrames; ++f) {
+        ASCIIFrame frame(columns, rows);
+        for (int y = 0; y < rows; ++y) {
+            for (int x = 0; x < columns; ++x) {
+                const int sx = x + 2 * f;
+                const int sy = y + f / 4;
+                frame.at(x, y) = {gradient[(sx * sx + sy * 7) % gradient.size()], static_cast<std::uint8_t>(sx),
+                                  static_cast<std::uint8_t>(sy * 4), static_cast<std::uint8_t>(sx ^ sy)};
+            }
+        }
+        video.push_back(frame);
+    }
+    return video;
+}
+
+template <typename Fn>
+static double timeSeconds(Fn&& fn) {
+    const auto start = std::chrono::steady_clock::now();
+    fn();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void benchBitPacking(const ASCIIVideo& video, Node* huffmanTree, const HuffmanCodeTable& legacyCodes,
+                            const HuffmanCodeTable& codes) {
+    std::println("\n=== Bit packing and cell parsing ===");
+    const std::size_t cells = video.size() * video.cellsPerFrame();
+
+    std::unordered_map<int, legacy::Frame> legacyVideo;
+    for (std::size_t frameNum = 0; frameNum < video.size(); ++frameNum) {
+        legacyVideo[static_cast<int>(frameNum)] = legacy::toLegacyFrame(video[frameNum]);
+    }
+
+    std::vector<std::vector<std::uint8_t>> packed(video.size());
+    const double legacyPack = timeSeconds([&] {
+        for (const auto& [frameNum, frame] : legacyVideo) {
+            packed[frameNum] = legacy::pack(frame, legacyCodes);
+        }
+    });
+
+    std::vector<std::vector<std::uint8_t>> packedWords(video.size());
+    const double wordPack = timeSeconds([&] {
+        for (std::size_t frameNum = 0; frameNum < video.size(); ++frameNum) {
+            BitWriter bits;
+            for (const Cell& cell : video[frameNum].cells) {
+                writeCell(bits, cell, codes);
+            }
+            packedWords[frameNum] = bits.finish();
+        }
+    });
+
+    std::size_t legacyChecksum = 0;
+    const double legacyUnpack = timeSeconds([&] {
+        for (std::size_t frameNum = 0; frameNum < video.size(); ++frameNum) {
+            legacyChecksum += legacy::unpack(packed[frameNum], video.cellsPerFrame(), huffmanTree);
+        }
+    });
+
+    const HuffmanDecoder decoder(codes);
+    std::size_t wordChecksum = 0;
+    const double wordUnpack = timeSeconds([&] {
+        for (std::size_t frameNum = 0; frameNum < video.size(); ++frameNum) {
+            BitReader bits(packedWords[frameNum], packedWords[frameNum].size() * 8);
+            for (std::size_t c = 0; c < video.cellsPerFrame(); ++c) {
+                const Cell cell = parsePixel(decoder, bits);
+                wordChecksum += static_cast<unsigned char>(cell.glyph) + cell.r + cell.g + cell.b;
+            }
+        }
+    });
+
+    const double mcells = static_cast<double>(cells) / 1e6;
+    std::size_t legacyBytes = 0;
+    std::size_t wordBytes = 0;
+    for (std::size_t f = 0; f < packed.size(); ++f) {
+        legacyBytes += packed[f].size();
+        wordBytes += packedWords[f].size();
+    }
+    std::println("Cells: {}, checksums match: {}", cells, legacyChecksum == wordChecksum ? "YES" : "NO");
+    std::println("Bytes per cell: pair<char, rgb> {}, Cell {}", sizeof(legacy::Frame::value_type), sizeof(Cell));
+    std::println("Payload v1 (length-prefixed tree codes): {} bytes   v2 (canonical codes): {} bytes", legacyBytes, wordBytes);
+    std::println("Pack   string: {:8.2f} Mcells/s   BitWriter: {:8.2f} Mcells/s   ({:.1f}x)",
+                 mcells / legacyPack, mcells / wordPack, legacyPack / wordPack);
+    std::println("Parse  string + tree walk: {:8.2f} Mcells/s   BitReader + lookup table: {:8.2f} Mcells/s   ({:.1f}x)",
+                 mcells / legacyUnpack, mcells / wordUnpack, legacyUnpack / wordUnpack);
+}
+
+static void benchGlyphLanes(const ASCIIVideo& video) {
+    std::println("\n=== Glyph lanes ===");
+
+    // Every glyph of the video coded as one stream, and dealt over
+    // kGlyphLanes lanes as a v13 Huffman payload does
+    SymbolCounts counts{};
+    for (std::size_t f = 0; f < video.size(); ++f) {
+        for (const Cell& cell : video[f].cells) {
+            counts[static_cast<unsigned char>(cell.glyph)]++;
+        }
+    }
+    std::array<HuffmanCodeTable, kContextCount> codes{};
+    codes[kGlyphContext] = buildCanonicalCodes(buildCodeLengths(counts));
+    std::array<HuffmanDecoder, kContextCount> decoders;
+    decoders[kGlyphContext].assign(codes[kGlyphContext]);
+
+    BitWriter single;
+    std::array<BitWriter, kHuffmanStreams> streams;
+    std::size_t glyphCount = 0;
+    for (std::size_t f = 0; f < video.size(); ++f) {
+        for (const Cell& cell : video[f].cells) {
+            const HuffmanCode& code = codes[kGlyphContext][static_cast<unsigned char>(cell.glyph)];
+            single.writeBits(code.bits, code.length);
+            streams[1 + glyphCount++ % kGlyphLanes].writeBits(code.bits, code.length);
+        }
+    }
+    const std::size_t singleBits = single.bitCount();
+    const std::vector<std::uint8_t>& singleBytes = single.finish();
+    std::array<std::span<const std::uint8_t>, kHuffmanStreams> streamBytes;
+    std::array<int, kHuffmanStreams> streamBits{};
+    for (int stream = 1; stream < kHuffmanStreams; ++stream) {
+        streamBits[stream] = static_cast<int>(streams[stream].bitCount());
+        streamBytes[stream] = streams[stream].finish();
+    }
+
+    // Best of a few passes over warm buffers
+    std::vector<char> serial(glyphCount);
+    std::vector<char> laned(glyphCount);
+    double serialTime = 1e9;
+    double laneTime = 1e9;
+    for (int pass = 0; pass < 5; ++pass) {
+        serialTime = std::min(serialTime, timeSeconds([&] {
+            BitReader bits(singleBytes, singleBits);
+            for (char& glyph : serial) {
+                glyph = decoders[kGlyphContext].decode(bits);
+            }
+        }));
+        laneTime = std::min(laneTime, timeSeconds([&] {
+            SplitHuffmanSymbolReader symbols(decoders, {}, 0, streamBytes, streamBits, laned,
+                                             static_cast<int>(glyphCount));
+        }));
+    }
+    const double mglyphs = static_cast<double>(glyphCount) / 1e6;
+    std::println("One stream: {:8.2f} Mglyphs/s   {} lanes: {:8.2f} Mglyphs/s   ({:.1f}x), match: {}", mglyphs / serialTime,
+                 kGlyphLanes, mglyphs / laneTime, serialTime / laneTime, serial == laned ? "YES" : "NO");
+}
+
+static void benchDeltaIndices() {
+    std::println("\n=== Delta index coding ===");
+    const ASCIIVideo video = makeMovingBlockVideo(120, 200, 60);
+
+    // Index bits only: 32 per changed cell before, Exp-Golomb gap and run length now
+    std::size_t changes = 0;
+    BitWriter runBits;
+    for (std::size_t f = 1; f < video.size(); ++f) {
+        const ASCIIFrameView frame = video[f];
+        const ASCIIFrameView prev = video[f - 1];
+        std::size_t runEnd = 0;
+        for (std::size_t i = 0; i < frame.size(); ++i) {
+            if (frame[i] == prev[i]) {
+                continue;
+            }
+            std::size_t end = i + 1;
+            while (end < frame.size() && frame[end] != prev[end]) {
+                ++end;
+            }
+            runBits.writeExpGolomb(static_cast<std::uint32_t>(i - runEnd));
+            runBits.writeExpGolomb(static_cast<std::uint32_t>(end - i - 1));
+            changes += end - i;
+            runEnd = end;
+            i = end;
+        }
+    }
+
+    compressASCIIVideo(video, "bench_delta.bin");
+    const std::size_t absoluteBytes = changes * 4;
+    const std::size_t runBytes = (runBits.bitCount() + 7) / 8;
+    const std::size_t fileBytes = fs::file_size("bench_delta.bin");
+    std::println("Changed cells: {}", changes);
+    std::println("Index bytes  absolute: {}   runs: {}   ({:.1f}x smaller)", absoluteBytes, runBytes,
+                 static_cast<double>(absoluteBytes) / runBytes);
+    std::println("File size: {} bytes (would be {} with absolute indices)", fileBytes,
+                 fileBytes - runBytes + absoluteBytes);
+}
+
+static void benchTileMaps(const ASCIIVideo& video) {
+    std::println("\n=== Tile change maps ===");
+    const double mcells = static_cast<double>((video.size() - 1) * video.cellsPerFrame()) / 1e6;
+
+    // Flagging the changed cells of every delta frame: a compare per cell,
+    // then the change map with its tile masks
+    std::size_t naiveChanges = 0;
+    const double naiveTime = timeSeconds([&] {
+        for (std::size_t f = 1; f < video.size(); ++f) {
+            const ASCIIFrameView frame = video[f];
+            const ASCIIFrameView prev = video[f - 1];
+            std::vector<std::uint8_t> flags(frame.size());
+            for (std::size_t i = 0; i < frame.size(); ++i) {
+                flags[i] = frame[i] != prev[i];
+            }
+            naiveChanges += std::count(flags.begin(), flags.end(), 1);
+        }
+    });
+    std::size_t tileChanges = 0;
+    const double tileTime = timeSeconds([&] {
+        for (std::size_t f = 1; f < video.size(); ++f) {
+            const ChangeMap map(video[f], video[f - 1]);
+            tileChanges += std::count(map.cells.begin(), map.cells.end(), 1);
+        }
+    });
+    std::println("Per cell: {:8.1f} Mcells/s   change map: {:8.1f} Mcells/s   ({:.1f}x), agree: {}", mcells / naiveTime,
+                 mcells / tileTime, naiveTime / tileTime, naiveChanges == tileChanges ? "YES" : "NO");
+
+    // Index bits for the same frames as runs and as tile maps
+    BitWriter runBits;
+    std::size_t tileBits = 0;
+    for (std::size_t f = 1; f < video.size(); ++f) {
+        const ChangeMap map(video[f], video[f - 1]);
+        tileBits += map.tileMapBits();
+        std::size_t runEnd = 0;
+        for (std::size_t i = 0; i < map.cells.size(); ++i) {
+            if (!map.changed(i)) {
+                continue;
+            }
+            std::size_t end = i + 1;
+            while (end < map.cells.size() && map.changed(end)) {
+                ++end;
+            }
+            runBits.writeExpGolomb(static_cast<std::uint32_t>(i - runEnd));
+            runBits.writeExpGolomb(static_cast<std::uint32_t>(end - i - 1));
+            runEnd = end;
+            i = end;
+        }
+    }
+    std::println("Index bytes  runs: {}   tile maps: {}", (runBits.bitCount() + 7) / 8, (tileBits + 7) / 8);
+}
+
+static void benchPans() {
+    std::println("\n=== Pan detection ===");
+    const ASCIIVideo video = makePanningVideo(120, 200, 60);
+
+    // Cells each delta codes in place, and after moving the previous frame
+    std::size_t inPlace = 0;
+    std::size_t afterPan = 0;
+    for (std::size_t f = 1; f < video.size(); ++f) {
+        const ASCIIFrameView frame = video[f];
+        const ASCIIFrameView prev = video[f - 1];
+        for (std::size_t i = 0; i < frame.size(); ++i) {
+            inPlace += frame[i] != prev[i];
+        }
+        SymbolCounter counter;
+        afterPan += static_cast<std::size_t>(writeFrameCells(counter, frame, true, prev, CellCoding{},
+                                                                     choosePan(frame, prev)));
+    }
+
+    const double encodeTime = timeSeconds([&] { compressASCIIVideo(video, "bench_pans.bin"); });
+    ASCIIVideo decoded;
+    const double decodeTime = timeSeconds([&] { decoded = decompressASCIIVideo("bench_pans.bin"); });
+    std::println("Changed cells  in place: {}   after pan: {}", inPlace, afterPan);
+    std::println("File size: {} bytes, encode {:.3f}s, decode {:.3f}s, exact: {}", fs::file_size("bench_pans.bin"),
+                 encodeTime, decodeTime, decoded == video ? "YES" : "NO");
+}
+
+static void benchKeyFrameChoice() {
+    std::println("\n=== Key frame choice ===");
+
+    // A fast edit cutting between three shots every eight frames
+    const std::array<ASCIIVideo, 3> shots{makeMovingBlockVideo(120, 200, 60), makeSyntheticVideo(120, 200, 60),
+                                          makePanningVideo(120, 200, 60)};
+    ASCIIVideo video(200, 60);
+    for (std::size_t f = 0; f < 120; ++f) {
+        video.push_back(shots[f / 8 % shots.size()][f]);
+    }
+
+    for (const bool adaptive : {false, true}) {
+        EncoderOptions options;
+        options.adaptiveKeyFrames = adaptive;
+        const double encodeTime = timeSeconds([&] { compressASCIIVideo(video, "bench_keys.bin", options); });
+        ASCIIVideoDecoder decoder(false);
+        std::size_t seekPoints = 0;
+        int keyFrames = 0;
+        const double decodeTime = timeSeconds([&] {
+            decoder.open("bench_keys.bin");
+            seekPoints = decoder.keyFrames().size();
+            while (decoder.next()) {
+                keyFrames += decoder.keyFrame();
+            }
+        });
+        std::println("{:8} {:9} bytes, {} seek points, {} key frames, encode {:.3f}s, decode {:.3f}s",
+                     adaptive ? "Adaptive" : "Fixed", fs::file_size("bench_keys.bin"), seekPoints, keyFrames,
+                     encodeTime, decodeTime);
+    }
+}
+
+static void benchReferenceFrames() {
+    std::println("\n=== Reference frames ===");
+
+    // A twelve-frame GIF-style loop played ten times, cutting to a title card
+    // between plays
+    const ASCIIVideo source = makeSyntheticVideo(96, 200, 60);
+    ASCIIFrame title(200, 60);
+    for (int x = 60; x < 140; ++x) {
+        title.at(x, 30) = {'T', 255, 255, 255};
+    }
+    ASCIIVideo video(200, 60);
+    for (int play = 0; play < 10; ++play) {
+        for (std::size_t f = 0; f < 96; f += 8) {
+            video.push_back(source[f]);
+        }
+        video.push_back(title);
+    }
+
+    for (const bool references : {false, true}) {
+        EncoderOptions options;
+        options.referenceFrames = references;
+        const double encodeTime = timeSeconds([&] { compressASCIIVideo(video, "bench_references.bin", options); });
+        ASCIIVideo decoded;
+        const double decodeTime = timeSeconds([&] { decoded = decompressASCIIVideo("bench_references.bin", 0, -1, 1); });
+        std::println("{:18} {:9} bytes, encode {:.3f}s, decode {:.3f}s, exact: {}",
+                     references ? "Reference slots:" : "Previous frame:", fs::file_size("bench_references.bin"),
+                     encodeTime, decodeTime, decoded == video ? "YES" : "NO");
+    }
+}
+
+static void benchBufferedDecode(const ASCIIVideo& video) {
+    std::println("\n=== Decoding into a caller buffer ===");
+    compressASCIIVideo(video, "bench_buffered.bin", {});
+    const double mcells = static_cast<double>(video.size() * video.cellsPerFrame()) / 1e6;
+
+    // A player copying each decoded frame out, against one handing the
+    // decoder its own buffer and only taking the changed cells
+    std::vector<Cell> cells(video.cellsPerFrame());
+    std::vector<std::uint32_t> changed;
+    ASCIIVideoDecoder decoder(false);
+    bool exact = true;
+    const double copyTime = timeSeconds([&] {
+        decoder.open("bench_buffered.bin");
+        for (std::size_t f = 0; decoder.next(); ++f) {
+            std::ranges::copy(decoder.frame().cells, cells.begin());
+            exact = exact && std::ranges::equal(cells, video[f].cells);
+        }
+    });
+    const double bufferTime = timeSeconds([&] {
+        decoder.open("bench_buffered.bin");
+        for (std::size_t f = 0; decoder.next(cells, changed); ++f) {
+            exact = exact && std::ranges::equal(cells, video[f].cells);
+        }
+    });
+    std::println("Copy out:      {:8.2f} Mcells/s", mcells / copyTime);
+    std::println("Caller buffer: {:8.2f} Mcells/s, exact: {}", mcells / bufferTime, exact ? "YES" : "NO");
+}
+
+static void benchTemporalColour(const ASCIIVideo& video) {
+    std::println("\n=== Temporal colour residuals ===");
+    EncoderOptions options;
+    options.temporalColour = true;
+
+    const double spatialTime = timeSeconds([&] { compressASCIIVideo(video, "bench_spatial.bin"); });
+    const double temporalTime = timeSeconds([&] { compressASCIIVideo(video, "bench_temporal.bin", options); });
+    ASCIIVideo decoded;
+    const double decodeTime = timeSeconds([&] { decoded = decompressASCIIVideo("bench_temporal.bin"); });
+
+    std::println("Spatial:  {} bytes ({:.3f}s)", fs::file_size("bench_spatial.bin"), spatialTime);
+    std::println("Temporal: {} bytes ({:.3f}s), decode {:.3f}s, exact: {}", fs::file_size("bench_temporal.bin"),
+                 temporalTime, decodeTime, decoded == video ? "YES" : "NO");
+}
+
+static void benchPalette(const ASCIIVideo& video) {
+    std::println("\n=== Cell palette ===");
+    EncoderOptions options;
+    options.palette = true;
+
+    const double plainTime = timeSeconds([&] { compressASCIIVideo(video, "bench_no_palette.bin"); });
+    const double paletteTime = timeSeconds([&] { compressASCIIVideo(video, "bench_palette.bin", options); });
+    ASCIIVideo decoded;
+    const double decodeTime = timeSeconds([&] { decoded = decompressASCIIVideo("bench_palette.bin"); });
+
+    std::println("Literals: {} bytes ({:.3f}s)", fs::file_size("bench_no_palette.bin"), plainTime);
+    std::println("Palette:  {} bytes ({:.3f}s), decode {:.3f}s, exact: {}", fs::file_size("bench_palette.bin"),
+                 paletteTime, decodeTime, decoded == video ? "YES" : "NO");
+}
+
+static void benchLossyDeltas(const ASCIIVideo& video) {
+    std::println("\n=== Lossy delta threshold ===");
+
+    // The same frames under +-2 of sensor-like noise on every channel
+    ASCIIVideo noisy(video.width(), video.height());
+    noisy.reserve(video.size());
+    std::uint32_t seed = 1;
+    for (std::size_t f = 0; f < video.size(); ++f) {
+        noisy.push_back(video[f]);
+        for (Cell& cell : noisy.frameCells(f)) {
+            for (std::uint8_t* channel : {&cell.r, &cell.g, &cell.b}) {
+                seed = seed * 1664525u + 1013904223u;
+                *channel = static_cast<std::uint8_t>(std::clamp(*channel + static_cast<int>(seed >> 29) % 5 - 2, 0, 255));
+            }
+        }
+    }
+
+    EncoderOptions channelOptions;
+    channelOptions.tolerance.channel = {3, 3, 3};
+    EncoderOptions lumaOptions;
+    lumaOptions.tolerance.luma = 3;
+    for (const auto& [options, name] : {std::pair{EncoderOptions{}, "Lossless"}, std::pair{channelOptions, "Channel 3"},
+                                        std::pair{lumaOptions, "Luma 3"}}) {
+        const double encodeTime = timeSeconds([&] { compressASCIIVideo(noisy, "bench_lossy.bin", options); });
+        ASCIIVideo decoded;
+        const double decodeTime = timeSeconds([&] { decoded = decompressASCIIVideo("bench_lossy.bin"); });
+        std::println("{:10} {:9} bytes, encode {:.3f}s, decode {:.3f}s", name, fs::file_size("bench_lossy.bin"),
+                     encodeTime, decodeTime);
+    }
+}
+
+static void benchEntropyCoders(const ASCIIVideo& video) {
+    std::println("\n=== Entropy coders ===");
+    const double mcells = static_cast<double>(video.size() * video.cellsPerFrame()) / 1e6;
+
+    for (const auto& [coder, name] : {std::pair{EntropyCoder::Huffman, "Huffman"}, std::pair{EntropyCoder::Rans, "rANS"}}) {
+        EncoderOptions options;
+        options.threads = 1;
+        options.entropyCoder = coder;
+        const double encodeTime = timeSeconds([&] { compressASCIIVideo(video, "bench_coder.bin", options); });
+        ASCIIVideo decoded;
+        const double decodeTime = timeSeconds([&] { decoded = decompressASCIIVideo("bench_coder.bin", 0, -1, 1); });
+        std::println("{:8} {:9} bytes, encode {:8.2f} Mcells/s, decode {:8.2f} Mcells/s, exact: {}", name,
+                     fs::file_size("bench_coder.bin"), mcells / encodeTime, mcells / decodeTime,
+                     decoded == video ? "YES" : "NO");
+    }
+}
+
+static void benchRoundTrip(const ASCIIVideo& video) {
+    std::println("\n=== Codec round trip ===");
+    const std::size_t cells = video.size() * video.cellsPerFrame();
+
+    const double compressTime = timeSeconds([&] { compressASCIIVideo(video, "bench_video.bin"); });
+    ASCIIVideo decoded;
+    const double decompressTime = timeSeconds([&] { decoded = decompressASCIIVideo("bench_video.bin"); });
+
+    const double mcells = static_cast<double>(cells) / 1e6;
+    std::println("Compress:   {:8.2f} Mcells/s ({:.3f}s)", mcells / compressTime, compressTime);
+    std::println("Decompress: {:8.2f} Mcells/s ({:.3f}s)", mcells / decompressTime, decompressTime);
+    std::println("File size: {} bytes, round trip exact: {}",
+                 fs::file_size("bench_video.bin"), decoded == video ? "YES" : "NO");
+}
+
+static void benchParallelEncode(const ASCIIVideo& video) {
+    std::println("\n=== Parallel segment encoding ===");
+    const double mcells = static_cast<double>(video.size() * video.cellsPerFrame()) / 1e6;
+    const int hardwareThreads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+
+    double serial = 0.0;
+    for (int threads = 1; threads <= hardwareThreads; threads *= 2) {
+        const double seconds = timeSeconds([&] {
+            ASCIIVideoEncoder encoder(EncoderOptions{16, 16, threads});
+            encoder.open("bench_parallel.bin");
+            for (std::size_t i = 0; i < video.size(); ++i) {
+                encoder.pushFrame(video[i]);
+            }
+            encoder.finish();
+        });
+        if (threads == 1) {
+            serial = seconds;
+        }
+        std::println("Threads {:2}: {:8.2f} Mcells/s ({:.1f}x)", threads, mcells / seconds, serial / seconds);
+    }
+}
+
+static void benchParallelDecode(const ASCIIVideo& video) {
+    std::println("\n=== Parallel group decoding ===");
+    const double mcells = static_cast<double>(video.size() * video.cellsPerFrame()) / 1e6;
+    const int hardwareThreads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+
+    // bench_parallel.bin is left behind by benchParallelEncode, with a key frame every 16 frames
+    double serial = 0.0;
+    for (int threads = 1; threads <= hardwareThreads; threads *= 2) {
+        ASCIIVideo decoded;
+        const double seconds = timeSeconds([&] { decoded = decompressASCIIVideo("bench_parallel.bin", 0, -1, threads); });
+        if (threads == 1) {
+            serial = seconds;
+        }
+        std::println("Threads {:2}: {:8.2f} Mcells/s ({:.1f}x), exact: {}", threads, mcells / seconds, serial / seconds,
+                     decoded == video ? "YES" : "NO");
+    }
+}
+
+int main() {
+    std::println("Starting Codec Benchmarks...");
+
+    const ASCIIVideo video = makeSyntheticVideo(120, 200, 60);
+
+    std::unordered_map<char, int> charFreq;
+    for (std::size_t frameNum = 0; frameNum < video.size(); ++frameNum) {
+        for (const Cell& cell : video[frameNum].cells) {
+            charFreq[cell.glyph]++;
+        }
+    }
+    Node* huffmanTree = buildHuffmanTree(charFreq);
+    HuffmanCodeTable legacyCodes{};
+    generateCodes(huffmanTree, 0, 0, legacyCodes);
+    const HuffmanCodeTable codes = buildCanonicalCodes(buildCodeLengths(charFreq));
+
+    benchBitPacking(video, huffmanTree, legacyCodes, codes);
+    deleteHuffmanTree(huffmanTree);
+    benchGlyphLanes(video);
+    benchDeltaIndices();
+    benchTileMaps(video);
+    benchTileMaps(makeMovingBlockVideo(120, 200, 60));
+    benchPans();
+    benchKeyFrameChoice();
+    benchReferenceFrames();
+    benchBufferedDecode(makeMovingBlockVideo(120, 200, 60));
+    benchBufferedDecode(video);
+    benchRoundTrip(video);
+    benchTemporalColour(video);
+    benchEntropyCoders(video);
+    benchPalette(video);
+    benchLossyDeltas(video);
+    benchParallelEncode(video);
+    benchParallelDecode(video);
+
+    std::println("\n=== All Benchmarks Complete ===");
+    return 0;
+}
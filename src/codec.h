@@ -2,6 +2,7 @@
 #define CODEC_H
 
 #include <array>
+#include <atomic>
 #include <unordered_map>
 #include <algorithm>
 #include <string>
@@ -9,14 +10,179 @@
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <limits>
+#include <memory>
 #include <print>
-#include <bitset>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <span>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 
 namespace fs = std::filesystem;
 
-using rgb = std::array<unsigned int, 3>;
-using ASCIIVideo = std::unordered_map<int, std::vector<std::pair<char, rgb>>>;
+// One glyph and its RGB888 colour, packed into 32 bits
+struct Cell {
+    char glyph = ' ';
+    std::uint8_t r = 0;
+    std::uint8_t g = 0;
+    std::uint8_t b = 0;
+
+    bool operator==(const Cell&) const = default;
+};
+static_assert(sizeof(Cell) == 4, "Cell must pack into 32 bits");
+
+// A grid of cells stored row-major; rows have no separator cells.
+struct ASCIIFrame {
+    int width = 0;
+    int height = 0;
+    std::vector<Cell> cells;
+
+    ASCIIFrame() = default;
+    ASCIIFrame(int width, int height)
+        : width(width), height(height), cells(static_cast<std::size_t>(width) * height) {}
+    ASCIIFrame(int width, int height, std::vector<Cell> cells)
+        : width(width), height(height), cells(std::move(cells)) {}
+
+    std::size_t size() const { return cells.size(); }
+    Cell& operator[](std::size_t i) { return cells[i]; }
+    const Cell& operator[](std::size_t i) const { return cells[i]; }
+    Cell& at(int x, int y) { return cells[static_cast<std::size_t>(y) * width + x]; }
+    const Cell& at(int x, int y) const { return cells[static_cast<std::size_t>(y) * width + x]; }
+
+    bool operator==(const ASCIIFrame&) const = default;
+};
+
+// Non-owning view of one frame's grid
+struct ASCIIFrameView {
+    int width = 0;
+    int height = 0;
+    std::span<const Cell> cells;
+
+    ASCIIFrameView() = default;
+    ASCIIFrameView(int width, int height, std::span<const Cell> cells)
+        : width(width), height(height), cells(cells) {}
+    ASCIIFrameView(const ASCIIFrame& frame)
+        : width(frame.width), height(frame.height), cells(frame.cells) {}
+
+    std::size_t size() const { return cells.size(); }
+    const Cell& operator[](std::size_t i) const { return cells[i]; }
+    const Cell& at(int x, int y) const { return cells[static_cast<std::size_t>(y) * width + x]; }
+
+    bool operator==(const ASCIIFrameView& other) const {
+        return width == other.width && height == other.height && std::ranges::equal(cells, other.cells);
+    }
+};
+
+// Frames of a single grid size stored back to back in one slab. Frame i starts
+// at cell i * width * height, so indexing is a multiply and growth never
+// rehashes; reserve() up front when the frame count is known.
+class ASCIIVideo {
+public:
+    ASCIIVideo() = default;
+    ASCIIVideo(int width, int height) : frameWidth(width), frameHeight(height), sized(true) {}
+
+    int width() const { return frameWidth; }
+    int height() const { return frameHeight; }
+    std::size_t size() const { return frameCount; }
+    bool empty() const { return frameCount == 0; }
+    std::size_t cellsPerFrame() const { return static_cast<std::size_t>(frameWidth) * frameHeight; }
+
+    void reserve(std::size_t frames) { slab.reserve(frames * cellsPerFrame()); }
+
+    // Grows or shrinks to `frames` frames; new frames are blank
+    void resize(std::size_t frames) {
+        slab.resize(frames * cellsPerFrame());
+        frameCount = frames;
+    }
+
+    // The first frame fixes the grid size of an unsized video
+    void push_back(ASCIIFrameView frame) {
+        if (!sized) {
+            frameWidth = frame.width;
+            frameHeight = frame.height;
+            sized = true;
+        }
+        if (frame.width != frameWidth || frame.height != frameHeight || frame.size() != cellsPerFrame()) {
+            throw std::invalid_argument("Frame size does not match the video");
+        }
+        // The source may be a view into this video, so copy by offset after growing
+        const Cell* source = frame.cells.data();
+        const bool aliased = !slab.empty() && source >= slab.data() && source < slab.data() + slab.size();
+        const std::size_t sourceOffset = aliased ? static_cast<std::size_t>(source - slab.data()) : 0;
+        const std::size_t cells = cellsPerFrame();
+        slab.resize(slab.size() + cells);
+        std::copy_n(aliased ? slab.data() + sourceOffset : source, cells, slab.end() - static_cast<std::ptrdiff_t>(cells));
+        ++frameCount;
+    }
+
+    // Appends a blank frame, or a copy of the last one, and returns its cells
+    // for in-place decoding. The span is invalidated by the next append.
+    std::span<Cell> appendFrame(bool copyLast = false) {
+        if (!sized) {
+            throw std::logic_error("Video grid size is not set");
+        }
+        const std::size_t cells = cellsPerFrame();
+        slab.resize(slab.size() + cells);
+        if (copyLast && frameCount > 0) {
+            std::copy_n(slab.end() - 2 * static_cast<std::ptrdiff_t>(cells), cells, slab.end() - static_cast<std::ptrdiff_t>(cells));
+        }
+        ++frameCount;
+        return frameCells(frameCount - 1);
+    }
+
+    ASCIIFrameView operator[](std::size_t index) const {
+        return { frameWidth, frameHeight, std::span<const Cell>(slab).subspan(index * cellsPerFrame(), cellsPerFrame()) };
+    }
+
+    ASCIIFrameView at(std::size_t index) const {
+        if (index >= frameCount) {
+            throw std::out_of_range("Frame index out of range");
+        }
+        return (*this)[index];
+    }
+
+    std::span<Cell> frameCells(std::size_t index) {
+        return std::span<Cell>(slab).subspan(index * cellsPerFrame(), cellsPerFrame());
+    }
+
+    // Drops every frame but keeps the grid size and the slab's capacity
+    void clear() {
+        slab.clear();
+        frameCount = 0;
+    }
+
+    bool operator==(const ASCIIVideo&) const = default;
+
+private:
+    int frameWidth = 0;
+    int frameHeight = 0;
+    bool sized = false;
+    std::size_t frameCount = 0;
+    std::vector<Cell> slab;
+};
 
 
 struct Node {
@@ -64,328 +230,3018 @@ inline Node* buildHuffmanTree(const std::unordered_map<char, int>& uniqueChars)
     return heap[0];
 }
 
-// Serialize tree using pre-order traversal
-inline void writeHuffmanTree(std::ofstream& out, Node* root) {
-    if (!root) {
-        return;
-    }
-    
-    // Check if this is a leaf node
-    bool isLeaf = (!root->l && !root->r);
-    out.write(reinterpret_cast<const char*>(&isLeaf), sizeof(bool));
-    
-    if (isLeaf) {
-        // Write the character for leaf nodes
-        out.write(&root->character, sizeof(char));
-    } else {
-        // Recursively write left and right subtrees for internal nodes
-        writeHuffmanTree(out, root->l);
-        writeHuffmanTree(out, root->r);
-    }
+inline void deleteHuffmanTree(Node* root) {
+    if (!root) return;
+    deleteHuffmanTree(root->l);
+    deleteHuffmanTree(root->r);
+    delete root;
 }
 
-// Deserialize tree using pre-order traversal
-inline Node* readHuffmanTree(std::ifstream& in) {
-    bool isLeaf;
-    in.read(reinterpret_cast<char*>(&isLeaf), sizeof(bool));
+// A tree of 256 symbols is never deeper than this
+constexpr int kMaxTreeDepth = 256;
+
+// Deserialize tree using pre-order traversal. A flag byte other than 0 or 1,
+// a missing child or a tree deeper than kMaxTreeDepth gives nullptr.
+template <typename Input>
+inline Node* readHuffmanTree(Input& in, int depth = 0) {
+    std::uint8_t isLeaf;
+    if (depth >= kMaxTreeDepth || !in.read(reinterpret_cast<char*>(&isLeaf), 1) || isLeaf > 1) {
+        return nullptr;
+    }
     
     if (isLeaf) {
         char character;
-        in.read(&character, sizeof(char));
+        if (!in.read(&character, sizeof(char))) {
+            return nullptr;
+        }
         return new Node(character, 0); // freq not needed for decompression
     } else {
         Node* root = new Node('\0', 0);
-        root->l = readHuffmanTree(in);
-        root->r = readHuffmanTree(in);
+        root->l = readHuffmanTree(in, depth + 1);
+        root->r = root->l ? readHuffmanTree(in, depth + 1) : nullptr;
+        if (!root->r) {
+            deleteHuffmanTree(root);
+            return nullptr;
+        }
         return root;
     }
 }
 
+struct HuffmanCode {
+    std::uint64_t bits = 0;
+    int length = 0;
+};
+
+using HuffmanCodeTable = std::array<HuffmanCode, 256>;
+
 // Generate Huffman codes from tree
-inline void generateCodes(Node* root, const std::string& code, 
-                         std::unordered_map<char, std::string>& codes) {
+inline void generateCodes(Node* root, std::uint64_t code, int length, HuffmanCodeTable& codes) {
     if (!root) return;
     
     // If leaf node, store the code
     if (!root->l && !root->r) {
-        codes[root->character] = code.empty() ? "0" : code;
+        codes[static_cast<unsigned char>(root->character)] = length == 0 ? HuffmanCode{0, 1} : HuffmanCode{code, length};
         return;
     }
     
-    generateCodes(root->l, code + "0", codes);
-    generateCodes(root->r, code + "1", codes);
+    generateCodes(root->l, code << 1, length + 1, codes);
+    generateCodes(root->r, (code << 1) | 1, length + 1, codes);
 }
 
-inline char findCharFromCode(Node* root, const std::string& code) {
+constexpr int kMaxCodeLength = 15;
+
+using CodeLengths = std::array<std::uint8_t, 256>;
+
+inline void collectCodeLengths(Node* root, int depth, std::array<int, 256>& depths) {
+    if (!root) return;
     if (!root->l && !root->r) {
-        return root->character;
+        depths[static_cast<unsigned char>(root->character)] = std::max(depth, 1);
+        return;
     }
-    
-    // Traverse tree to find character
-    Node* current = root;
-    for (char bit : code) {
-        if (bit == '0') {
-            current = current->l;
-        } else {
-            current = current->r;
+    collectCodeLengths(root->l, depth + 1, depths);
+    collectCodeLengths(root->r, depth + 1, depths);
+}
+
+// Huffman code lengths for the given frequencies, limited to maxLength bits.
+// Over-long codes are clamped and the Kraft sum is repaired by demoting the
+// deepest shorter codes, then lengths are handed back out by frequency.
+inline CodeLengths buildCodeLengths(const std::unordered_map<char, int>& charFreq, int maxLength = kMaxCodeLength) {
+    CodeLengths lengths{};
+    Node* huffmanTree = buildHuffmanTree(charFreq);
+    if (!huffmanTree) {
+        return lengths;
+    }
+    std::array<int, 256> depths{};
+    collectCodeLengths(huffmanTree, 0, depths);
+    deleteHuffmanTree(huffmanTree);
+
+    std::vector<int> countPerLength(std::max(maxLength, *std::max_element(depths.begin(), depths.end())) + 1, 0);
+    for (int depth : depths) {
+        if (depth > 0) {
+            countPerLength[std::min(depth, maxLength)]++;
         }
     }
-    return current->character;
-}
 
-inline unsigned char stringToByte(const std::string& bits, int start) {
-    unsigned char byte = 0;
-    for (int i = 0; i < 8; i++) {
-        if (start + i > static_cast<int>(bits.length())) {
-            break;
+    std::uint64_t kraft = 0;
+    for (int length = 1; length <= maxLength; ++length) {
+        kraft += static_cast<std::uint64_t>(countPerLength[length]) << (maxLength - length);
+    }
+    while (kraft > (std::uint64_t{1} << maxLength)) {
+        countPerLength[maxLength]--;
+        for (int length = maxLength - 1; length > 0; --length) {
+            if (countPerLength[length] > 0) {
+                countPerLength[length]--;
+                countPerLength[length + 1] += 2;
+                break;
+            }
         }
-        if (bits[start + i] == '1') {
-            int bit = 0b10000000 >> i;
-            byte |= bit;
+        kraft--;
+    }
+
+    std::vector<std::pair<int, unsigned char>> symbols;
+    for (const auto& [character, freq] : charFreq) {
+        symbols.emplace_back(freq, static_cast<unsigned char>(character));
+    }
+    std::sort(symbols.begin(), symbols.end(), [](const auto& a, const auto& b) {
+        return a.first != b.first ? a.first > b.first : a.second < b.second;
+    });
+
+    std::size_t next = 0;
+    for (int length = 1; length <= maxLength; ++length) {
+        for (int n = 0; n < countPerLength[length]; ++n) {
+            lengths[symbols[next++].second] = static_cast<std::uint8_t>(length);
         }
     }
-    return byte;
+    return lengths;
 }
 
-inline std::string byteToString(unsigned char byte) {
-    std::string bits;
-    bits.reserve(8);
-    int byteMask = 0b10000000;
-    for (int i = 0; i < 8; i++) {
-        if ((byte & byteMask) != 0) {
-            bits += '1';
-        } else {
-            bits += '0';
+using SymbolCounts = std::array<int, 256>;
+
+inline CodeLengths buildCodeLengths(const SymbolCounts& counts, int maxLength = kMaxCodeLength) {
+    std::unordered_map<char, int> freq;
+    for (int symbol = 0; symbol < static_cast<int>(counts.size()); ++symbol) {
+        if (counts[symbol] > 0) {
+            freq[static_cast<char>(symbol)] = counts[symbol];
         }
-        byteMask >>= 1;
     }
-    return bits;
+    return buildCodeLengths(freq, maxLength);
 }
 
-inline void writeBitString(std::ofstream& out, const std::string& bits) {
-    int bitCount = bits.length();
-    unsigned char remainder = bitCount % 8;
-
-    out.write(reinterpret_cast<const char*>(&bitCount), sizeof(int));
-    for (int i = 0; i < bitCount; i += 8) {
-        unsigned char byte = stringToByte(bits, i);
-        out.write(reinterpret_cast<const char*>(&byte), sizeof(byte));
+// Canonical codes: symbols ordered by (length, value) receive consecutive codes,
+// so the lengths alone are enough to rebuild the table.
+inline HuffmanCodeTable buildCanonicalCodes(const CodeLengths& lengths) {
+    // Walked by length rather than sorted, so rebuilding a decoder allocates nothing
+    HuffmanCodeTable codes{};
+    std::uint64_t code = 0;
+    int prevLength = 0;
+    const int maxLength = *std::ranges::max_element(lengths);
+    for (int length = 1; length <= maxLength; ++length) {
+        for (int symbol = 0; symbol < static_cast<int>(lengths.size()); ++symbol) {
+            if (lengths[symbol] == length) {
+                code <<= length - prevLength;
+                codes[symbol] = {code, lengths[symbol]};
+                ++code;
+                prevLength = length;
+            }
+        }
     }
-    out.write(reinterpret_cast<const char*>(&remainder), sizeof(unsigned char));
+    return codes;
 }
 
-inline std::string readBitsAsString(std::ifstream& in, int bitCount) {
-    std::string bits = "";
+// Appends bits MSB-first through a 64-bit accumulator and spills whole 32-bit
+// words, so the packed bytes match the old '0'/'1' string packing exactly.
+class BitWriter {
+public:
+    void writeBits(std::uint64_t value, int count) {
+        if (count > 32) {
+            writeBits(value >> 32, count - 32);
+            count = 32;
+        }
+        if (count <= 0) {
+            return;
+        }
+        accumulator = (accumulator << count) | (value & (~std::uint64_t{0} >> (64 - count)));
+        pending += count;
+        totalBits += count;
+        if (pending >= 32) {
+            pending -= 32;
+            const auto word = static_cast<std::uint32_t>(accumulator >> pending);
+            buffer.push_back(static_cast<std::uint8_t>(word >> 24));
+            buffer.push_back(static_cast<std::uint8_t>(word >> 16));
+            buffer.push_back(static_cast<std::uint8_t>(word >> 8));
+            buffer.push_back(static_cast<std::uint8_t>(word));
+        }
+    }
 
-    unsigned char byte;
-    int count = (bitCount + 7) / 8;  // Number of bytes to read
-    while (count > 0 && in.read(reinterpret_cast<char*>(&byte), 1)) {
-        bits += byteToString(byte);
-        count--;
+    // Order-0 Exp-Golomb: value + 1 in binary behind one zero per bit after its
+    // leading one, so 0, 1-2, 3-6... cost 1, 3, 5... bits
+    void writeExpGolomb(std::uint32_t value) {
+        const std::uint64_t coded = std::uint64_t{value} + 1;
+        writeBits(coded, 2 * std::bit_width(coded) - 1);
     }
 
-    bits.resize(bitCount);
-    return bits;
-}
+    std::size_t bitCount() const { return totalBits; }
 
-inline void compressFrame(std::ofstream& out, 
-                         const std::vector<std::pair<char, rgb>>& frame,
-                         const std::unordered_map<char, std::string>& huffmanCodes,
-                         bool useDelta,
-                         const std::vector<std::pair<char, rgb>>& prevFrame) {
-    std::string bitString;
+    // Pads the last byte with zero bits and returns the packed bytes.
+    const std::vector<std::uint8_t>& finish() {
+        while (pending >= 8) {
+            pending -= 8;
+            buffer.push_back(static_cast<std::uint8_t>(accumulator >> pending));
+        }
+        if (pending > 0) {
+            buffer.push_back(static_cast<std::uint8_t>(accumulator << (8 - pending)));
+            pending = 0;
+        }
+        return buffer;
+    }
 
-    if (!useDelta) {
-        // Compress full frame
-        int frameSize = static_cast<int>(frame.size());
-        out.write(reinterpret_cast<const char*>(&frameSize), sizeof(int));
+    void clear() {
+        buffer.clear();
+        accumulator = 0;
+        pending = 0;
+        totalBits = 0;
+    }
+
+private:
+    std::vector<std::uint8_t> buffer;
+    std::uint64_t accumulator = 0;
+    int pending = 0;
+    std::size_t totalBits = 0;
+};
+
+// Reads bits MSB-first from a byte buffer. The accumulator is kept left-aligned
+// and refilled eight bytes at a time; reads past the end yield zero bits and are
+// reported through overrun().
+class BitReader {
+public:
+    // Reads nothing; for arrays of readers assigned later
+    BitReader() : BitReader(nullptr, 0, 0) {}
+
+    BitReader(const std::uint8_t* data, std::size_t size, std::size_t bitLimit)
+        : data(data), size(size), bitLimit(bitLimit) {}
 
-        for (const auto& [ch, color] : frame) {
-            bitString.append(std::bitset<8>(huffmanCodes.at(ch).length()).to_string());
-            bitString.append(huffmanCodes.at(ch));
-            bitString.append(std::bitset<8>(color[0]).to_string());
-            bitString.append(std::bitset<8>(color[1]).to_string());
-            bitString.append(std::bitset<8>(color[2]).to_string());
+    BitReader(std::span<const std::uint8_t> bytes, std::size_t bitLimit)
+        : BitReader(bytes.data(), bytes.size(), bitLimit) {}
+
+    // count must be in [1, 57]
+    std::uint64_t peekBits(int count) {
+        if (available < count) {
+            refill();
         }
+        return accumulator >> (64 - count);
+    }
 
-        writeBitString(out, bitString);
-    } else {
-        // Delta encoding: only write changes
-        int numChanges = 0;
+    // Tops the accumulator up to at least 56 bits, which peekFilled() can then
+    // read from without checking
+    void fill() {
+        if (available < 56) {
+            refill();
+        }
+    }
+
+    std::uint64_t peekFilled(int count) const { return accumulator >> (64 - count); }
+
+    void skipBits(int count) {
+        accumulator <<= count;
+        available -= count;
+    }
+
+    std::uint64_t readBits(int count) {
+        if (count <= 0) {
+            return 0;
+        }
+        if (count > 32) {
+            const std::uint64_t high = readBits(count - 32);
+            return (high << 32) | readBits(32);
+        }
+        const std::uint64_t value = peekBits(count);
+        skipBits(count);
+        return value;
+    }
+
+    std::uint32_t readExpGolomb() {
+        const int zeros = std::countl_zero(static_cast<std::uint32_t>(peekBits(32)));
+        if (zeros >= 32) {
+            throw std::runtime_error("Invalid Exp-Golomb code");
+        }
+        return static_cast<std::uint32_t>(readBits(2 * zeros + 1) - 1);
+    }
+
+    // Every byte loaded is either consumed or still in the accumulator
+    std::size_t position() const { return next * 8 - static_cast<std::size_t>(available); }
+    bool overrun() const { return position() > bitLimit; }
 
-        for (size_t i = 0; i < frame.size(); ++i) {
-            if (i >= prevFrame.size() ||
-                frame[i].first != prevFrame[i].first ||
-                frame[i].second != prevFrame[i].second) {
-                const char ch = frame[i].first;
-                const rgb& color = frame[i].second;
-                bitString.append(std::bitset<32>(i).to_string());
-                bitString.append(std::bitset<8>(huffmanCodes.at(ch).length()).to_string());
-                bitString.append(huffmanCodes.at(ch));
-                bitString.append(std::bitset<8>(color[0]).to_string());
-                bitString.append(std::bitset<8>(color[1]).to_string());
-                bitString.append(std::bitset<8>(color[2]).to_string());
-                numChanges++;
+private:
+    void refill() {
+        if (next + 8 <= size) {
+            std::uint64_t word;
+            std::memcpy(&word, data + next, sizeof(word));
+            if constexpr (std::endian::native == std::endian::little) {
+                word = std::byteswap(word);
             }
+            accumulator |= word >> available;
+            next += (63 - available) >> 3;
+            available |= 56;
+            return;
         }
+        while (available <= 56) {
+            const std::uint64_t byte = next < size ? data[next] : 0;
+            ++next;
+            accumulator |= byte << (56 - available);
+            available += 8;
+        }
+    }
+
+    const std::uint8_t* data;
+    std::size_t size;
+    std::size_t bitLimit;
+    std::size_t next = 0;
+    std::uint64_t accumulator = 0;
+    int available = 0;
+};
 
-        out.write(reinterpret_cast<const char*>(&numChanges), sizeof(int));
-        writeBitString(out, bitString);
+constexpr int kHuffmanLookupBits = 10;
+
+// Resolves a symbol from the next kHuffmanLookupBits peeked bits with a single
+// table load. Codes longer than the table are kept sorted by (length, code) and
+// matched with a binary search per length on the slow path.
+class HuffmanDecoder {
+public:
+    HuffmanDecoder() = default;
+
+    explicit HuffmanDecoder(const HuffmanCodeTable& codes) { assign(codes); }
+
+    // Rebuilds the decoder for new codes, reusing its long-code storage
+    void assign(const HuffmanCodeTable& codes) {
+        table.fill({});
+        longCodes.clear();
+        for (int symbol = 0; symbol < static_cast<int>(codes.size()); ++symbol) {
+            const HuffmanCode& code = codes[symbol];
+            if (code.length == 0) {
+                continue;
+            }
+            if (code.length > 57) {
+                throw std::runtime_error("Huffman code too long");
+            }
+            if (code.length <= kHuffmanLookupBits) {
+                const int shift = kHuffmanLookupBits - code.length;
+                const std::size_t first = static_cast<std::size_t>(code.bits) << shift;
+                for (std::size_t i = first; i < first + (std::size_t{1} << shift); ++i) {
+                    table[i] = {static_cast<std::uint8_t>(symbol), static_cast<std::uint8_t>(code.length)};
+                }
+            } else {
+                longCodes.push_back({code.bits, code.length, static_cast<char>(symbol)});
+            }
+        }
+        std::sort(longCodes.begin(), longCodes.end(), [](const LongCode& a, const LongCode& b) {
+            return a.length != b.length ? a.length < b.length : a.bits < b.bits;
+        });
+    }
+
+    // Table-only decode from bits holding at least kHuffmanLookupBits after
+    // BitReader::fill(). Returns false, consuming nothing, for a long code.
+    bool decodeFilled(BitReader& bits, char& symbol) const {
+        const Entry& entry = table[bits.peekFilled(kHuffmanLookupBits)];
+        if (entry.length == 0) {
+            return false;
+        }
+        bits.skipBits(entry.length);
+        symbol = static_cast<char>(entry.symbol);
+        return true;
     }
-}
 
-static std::pair<char, rgb> parsePixel(Node* huffmanTree, const std::string& frameBits, int& start) {
-    const int codeLen = std::stoi(frameBits.substr(start, 8), nullptr, 2);
-    start += 8;
+    char decode(BitReader& bits) const {
+        const Entry& entry = table[bits.peekBits(kHuffmanLookupBits)];
+        if (entry.length != 0) {
+            bits.skipBits(entry.length);
+            return static_cast<char>(entry.symbol);
+        }
+        return decodeLong(bits);
+    }
 
-    const char character = findCharFromCode(huffmanTree, frameBits.substr(start, codeLen));
-    start += codeLen;
+private:
+    struct Entry {
+        std::uint8_t symbol = 0;
+        std::uint8_t length = 0;
+    };
 
-    const rgb color = {
-        static_cast<unsigned int>(std::stoi(frameBits.substr(start,    8), nullptr, 2)),
-        static_cast<unsigned int>(std::stoi(frameBits.substr(start+8,  8), nullptr, 2)),
-        static_cast<unsigned int>(std::stoi(frameBits.substr(start+16, 8), nullptr, 2))
+    struct LongCode {
+        std::uint64_t bits;
+        int length;
+        char symbol;
     };
-    start += 24;
 
-    return {character, color};
+    char decodeLong(BitReader& bits) const {
+        auto group = longCodes.begin();
+        while (group != longCodes.end()) {
+            const int length = group->length;
+            const auto groupEnd = std::find_if(group, longCodes.end(),
+                [length](const LongCode& code) { return code.length != length; });
+            const std::uint64_t peeked = bits.peekBits(length);
+            const auto match = std::lower_bound(group, groupEnd, peeked,
+                [](const LongCode& code, std::uint64_t value) { return code.bits < value; });
+            if (match != groupEnd && match->bits == peeked) {
+                bits.skipBits(length);
+                return match->symbol;
+            }
+            group = groupEnd;
+        }
+        throw std::runtime_error("Invalid Huffman code");
+    }
+
+    std::array<Entry, std::size_t{1} << kHuffmanLookupBits> table{};
+    std::vector<LongCode> longCodes;
+};
+
+// v1 files start with a bare frame count and a serialised tree; v2 and later
+// start with this magic, a header and the canonical code lengths.
+constexpr std::array<char, 4> kFileMagic{ 'A', 'S', 'C', 'V' };
+constexpr std::uint16_t kFormatVersion = 13;
+constexpr std::uint16_t kMinFormatVersion = 2;
+
+// Record tags. Table records (v4+) replace the Huffman code lengths for every
+// frame that follows them.
+enum class FrameType : std::uint8_t {
+    Key = 0,
+    Delta = 1,
+    Table = 2,
+    // v12: a slot byte; the next frame is coded against that slot's frame
+    Reference = 3,
+    // v12: a slot byte; the frame just decoded is kept in that slot
+    Keep = 4
+};
+
+// Decoded frames a v12 file can keep for later frames to reference. Slots
+// are empty at every seek point.
+constexpr int kReferenceSlots = 16;
+// Hashes of recent shots the encoder remembers, kept or not
+constexpr std::size_t kShotHistory = 64;
+
+// Entropy coder for every context-coded symbol, a header byte from v7 on.
+// Earlier files are Huffman.
+enum class EntropyCoder : std::uint8_t {
+    Huffman = 0,
+    Rans = 1
+};
+
+// v13 Huffman payloads deal glyph codes round-robin over this many lanes,
+// which follow the colour codes as sub-streams of their own
+constexpr int kGlyphLanes = 4;
+constexpr int kHuffmanStreams = 1 + kGlyphLanes;
+
+// Header flags
+constexpr std::uint16_t kFlagSeekIndex = 1 << 0; // file ends with a keyframe index
+constexpr std::uint16_t kFlagTemporalColour = 1 << 1; // delta colours are residuals against the previous frame
+constexpr std::uint16_t kFlagPalette = 1 << 2; // cells may be coded as palette slots (v8+)
+
+// Most cells a frame may hold. Grid sizes read from a file are checked
+// against it before anything is allocated for them.
+constexpr std::int64_t kMaxFrameCells = std::int64_t{1} << 24;
+
+inline bool validGridSize(std::int64_t width, std::int64_t height) {
+    return width >= 0 && height >= 0 && width * height <= kMaxFrameCells;
 }
 
-ASCIIVideo decompressASCIIVideo(const std::string& inPathStr) {
-    ASCIIVideo video;
-    fs::path inPath(inPathStr);
-    if (inPath.extension() != ".bin" || !fs::exists(inPath)) {
-        std::cerr << "This file does not exist or is not a bin file: " << inPathStr << '\n';
-        return video;
+// Seek index footer: int count, then count entries, then the int64 offset of
+// the footer itself as the last eight bytes of the file. Each entry points at
+// the table record that opens a key frame's segment.
+struct SeekEntry {
+    int frame;
+    std::int64_t offset;
+};
+
+template <typename T>
+inline void writeValue(std::ostream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T, typename Input>
+inline bool readValue(Input& in, T& value) {
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+// Frame payload framing: bit count followed by the packed bytes
+inline void writeBitStream(std::ostream& out, BitWriter& bits) {
+    const int bitCount = static_cast<int>(bits.bitCount());
+    const std::vector<std::uint8_t>& bytes = bits.finish();
+
+    writeValue(out, bitCount);
+    out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+}
+
+// v1 payloads carry one extra byte after the data holding bitCount % 8
+inline bool readBitStream(std::ifstream& in, int bitCount, std::vector<std::uint8_t>& bytes, bool legacyRemainder = false) {
+    if (bitCount < 0) {
+        return false;
+    }
+    bytes.resize((static_cast<std::size_t>(bitCount) + 7) / 8);
+    in.read(reinterpret_cast<char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    if (legacyRemainder) {
+        unsigned char remainder;
+        in.read(reinterpret_cast<char*>(&remainder), sizeof(unsigned char));
     }
+    return static_cast<bool>(in);
+}
 
-    std::println("Start Decompressing from: {}", inPath.string());
+// Bounds-checked cursor over a file held in memory. Reads that would run past
+// the end fail and leave the cursor in place; view() hands out spans into the
+// bytes instead of copying them.
+class ByteReader {
+public:
+    ByteReader() = default;
+    explicit ByteReader(std::span<const std::uint8_t> bytes) : bytes(bytes) {}
 
-    try {
-        std::ifstream packedBits(inPath, std::ios::binary);
-        if (!packedBits.is_open()) {
-            std::cerr << "Failed to open file: " << inPath.string() << '\n';
-            return video;
+    // Same shape as std::istream::read, so the read helpers take either
+    bool read(char* out, std::size_t count) {
+        if (count > remaining()) {
+            return false;
         }
+        std::memcpy(out, bytes.data() + pos, count);
+        pos += count;
+        return true;
+    }
 
-        int numframes;
-        packedBits.read(reinterpret_cast<char*>(&numframes), sizeof(int));
-        std::println("Number of frames: {}", numframes);
+    bool view(std::size_t count, std::span<const std::uint8_t>& out) {
+        if (count > remaining()) {
+            return false;
+        }
+        out = bytes.subspan(pos, count);
+        pos += count;
+        return true;
+    }
 
-        Node* huffmanTree = readHuffmanTree(packedBits);
-        if (!huffmanTree) {
-            std::cerr << "Failed to read Huffman tree\n";
-            return video;
+    bool seek(std::size_t offset) {
+        if (offset > bytes.size()) {
+            return false;
         }
-        std::println("Huffman tree loaded");
+        pos = offset;
+        return true;
+    }
 
-        for (int i = 0; i < numframes; i++) {
-            std::println("Decompressing frame {}/{}", i, numframes - 1);
+    std::size_t tell() const { return pos; }
+    std::size_t size() const { return bytes.size(); }
+    std::size_t remaining() const { return bytes.size() - pos; }
 
-            if (i == 0) {
-                // Full frame
-                int frameSize, bitCount;
-                packedBits.read(reinterpret_cast<char*>(&frameSize), sizeof(int));
-                packedBits.read(reinterpret_cast<char*>(&bitCount), sizeof(int));
-                std::println("  Frame 0: frameSize={}, bitCount={}", frameSize, bitCount);
+private:
+    std::span<const std::uint8_t> bytes;
+    std::size_t pos = 0;
+};
 
-                const std::string frameBits = readBitsAsString(packedBits, bitCount);
-                unsigned char remainder;
-                packedBits.read(reinterpret_cast<char*>(&remainder), sizeof(unsigned char));
+// Zero-copy frame payload: a view of the packed bytes in place
+inline bool readBitStream(ByteReader& in, int bitCount, std::span<const std::uint8_t>& bytes,
+                          bool legacyRemainder = false) {
+    std::uint8_t remainder;
+    return bitCount >= 0 && in.view((static_cast<std::size_t>(bitCount) + 7) / 8, bytes) &&
+           (!legacyRemainder || readValue(in, remainder));
+}
 
-                int start = 0;
-                std::vector<std::pair<char, rgb>> frame;
-                frame.reserve(frameSize);
-                for (int p = 0; p < frameSize; ++p) {
-                    frame.push_back(parsePixel(huffmanTree, frameBits, start));
-                }
-                std::println("  Frame 0 reconstructed with {} pixels", frame.size());
-                video[0] = std::move(frame);
-            } else {
-                // Delta frame
-                int numChanges, bitCount;
-                packedBits.read(reinterpret_cast<char*>(&numChanges), sizeof(int));
-                packedBits.read(reinterpret_cast<char*>(&bitCount), sizeof(int));
-                std::println("  Delta frame: {} changes, {} bits", numChanges, bitCount);
-
-                const std::string frameBits = readBitsAsString(packedBits, bitCount);
-                unsigned char remainder;
-                packedBits.read(reinterpret_cast<char*>(&remainder), sizeof(unsigned char));
-
-                int start = 0;
-                std::vector<std::pair<char, rgb>> frame = video[i - 1];
-                std::println("  Previous frame size: {}", frame.size());
-
-                for (int c = 0; c < numChanges; c++) {
-                    // Parse changed pixel
-                    const int index = std::stoi(frameBits.substr(start, 32), nullptr, 2);
-                    start += 32;
-
-                    if (index >= static_cast<int>(frame.size())) {
-                        std::cerr << "ERROR: Index " << index << " out of bounds (frame size: " << frame.size() << ")\n";
-                        throw std::out_of_range("Index out of bounds");
-                    }
+// A whole file in memory: mapped read-only when it is a regular file, read
+// into a buffer otherwise (pipes, or if mapping fails)
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile() { close(); }
 
-                    frame[index] = parsePixel(huffmanTree, frameBits, start);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const fs::path& path) {
+        close();
+#ifdef _WIN32
+        const HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                        FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file != INVALID_HANDLE_VALUE) {
+            LARGE_INTEGER size;
+            if (GetFileType(file) == FILE_TYPE_DISK && GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+                const HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                if (mapping) {
+                    // The view keeps the mapping alive
+                    mapped = static_cast<const std::uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+                    mappedSize = mapped ? static_cast<std::size_t>(size.QuadPart) : 0;
+                    CloseHandle(mapping);
                 }
-                video[i] = std::move(frame);
+            }
+            CloseHandle(file);
+        }
+        isOpen = mapped != nullptr || readAll(path);
+#else
+        const int file = ::open(path.c_str(), O_RDONLY);
+        if (file < 0) {
+            return false;
+        }
+        struct stat info;
+        if (::fstat(file, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+            void* address = ::mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+            if (address != MAP_FAILED) {
+                mapped = static_cast<const std::uint8_t*>(address);
+                mappedSize = static_cast<std::size_t>(info.st_size);
             }
         }
+        // A pipe can only be read once, so the fallback drains this descriptor
+        isOpen = mapped != nullptr || readAll(file);
+        // The mapping outlives the descriptor
+        ::close(file);
+#endif
+        return isOpen;
+    }
 
-        std::println("Video decompressed successfully: {} frames", video.size());
-        packedBits.close();
-        
-    } catch (const std::exception& e) {
-        std::cerr << "Exception during decompression: " << e.what() << '\n';
-        return ASCIIVideo{};
+    void close() {
+        if (mapped) {
+#ifdef _WIN32
+            UnmapViewOfFile(mapped);
+#else
+            ::munmap(const_cast<std::uint8_t*>(mapped), mappedSize);
+#endif
+        }
+        mapped = nullptr;
+        mappedSize = 0;
+        buffer.clear();
+        isOpen = false;
     }
 
-    return video;
+    bool is_open() const { return isOpen; }
+    bool isMapped() const { return mapped != nullptr; }
+
+    std::span<const std::uint8_t> bytes() const {
+        return mapped ? std::span<const std::uint8_t>(mapped, mappedSize) : std::span<const std::uint8_t>(buffer);
+    }
+
+private:
+    static constexpr std::size_t kReadChunk = 1 << 16;
+
+#ifdef _WIN32
+    bool readAll(const fs::path& path) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in.is_open()) {
+            return false;
+        }
+        while (in) {
+            const std::size_t used = buffer.size();
+            buffer.resize(used + kReadChunk);
+            in.read(reinterpret_cast<char*>(buffer.data() + used), kReadChunk);
+            buffer.resize(used + static_cast<std::size_t>(in.gcount()));
+        }
+        return in.eof();
+    }
+#else
+    bool readAll(int file) {
+        while (true) {
+            const std::size_t used = buffer.size();
+            buffer.resize(used + kReadChunk);
+            const ssize_t count = ::read(file, buffer.data() + used, kReadChunk);
+            if (count < 0 && errno == EINTR) {
+                buffer.resize(used);
+                continue;
+            }
+            buffer.resize(used + static_cast<std::size_t>(std::max<ssize_t>(count, 0)));
+            if (count <= 0) {
+                return count == 0;
+            }
+        }
+    }
+#endif
+
+    const std::uint8_t* mapped = nullptr;
+    std::size_t mappedSize = 0;
+    std::vector<std::uint8_t> buffer;
+    bool isOpen = false;
+};
+
+inline void writeCodeLengths(std::ostream& out, const CodeLengths& lengths) {
+    const auto symbolCount = static_cast<std::uint16_t>(
+        std::count_if(lengths.begin(), lengths.end(), [](std::uint8_t length) { return length > 0; }));
+    writeValue(out, symbolCount);
+    for (int symbol = 0; symbol < static_cast<int>(lengths.size()); ++symbol) {
+        if (lengths[symbol] > 0) {
+            writeValue(out, static_cast<std::uint8_t>(symbol));
+            writeValue(out, lengths[symbol]);
+        }
+    }
+}
+
+template <typename Input>
+inline bool readCodeLengths(Input& in, CodeLengths& lengths) {
+    lengths.fill(0);
+    std::uint16_t symbolCount;
+    if (!readValue(in, symbolCount) || symbolCount > lengths.size()) {
+        return false;
+    }
+    std::uint64_t kraft = 0;
+    for (int i = 0; i < symbolCount; ++i) {
+        std::uint8_t symbol, length;
+        if (!readValue(in, symbol) || !readValue(in, length) || length == 0 || length > kMaxCodeLength) {
+            return false;
+        }
+        lengths[symbol] = length;
+        kraft += std::uint64_t{1} << (kMaxCodeLength - length);
+    }
+    // Lengths that oversubscribe the code space cannot come from a prefix code
+    return kraft <= (std::uint64_t{1} << kMaxCodeLength);
 }
 
-inline void compressASCIIVideo(const ASCIIVideo& video, const std::string& outPathStr) {
-    fs::path outPath(outPathStr);
-    fs::path parentDir = outPath.parent_path();
+// Interleaved rANS. Two 32-bit states take alternate symbols and renormalise a
+// byte at a time; frequencies are scaled to kRansTotal per context.
+constexpr int kRansScaleBits = 12;
+constexpr std::uint32_t kRansTotal = 1u << kRansScaleBits;
+constexpr std::uint32_t kRansLowerBound = 1u << 23;
+constexpr int kRansStates = 2;
+
+using RansFrequencies = std::array<std::uint16_t, 256>;
 
-    if (!outPath.has_extension()) {
-        outPath.replace_extension(".bin");
+// Scales counts to sum to kRansTotal, keeping every counted symbol at least 1.
+// The rounding error goes to (or comes from) the most frequent symbols.
+inline RansFrequencies normalizeFrequencies(const SymbolCounts& counts) {
+    RansFrequencies freq{};
+    std::uint64_t total = 0;
+    for (int count : counts) {
+        total += count;
+    }
+    if (total == 0) {
+        return freq;
     }
 
-    try {
-        if (!parentDir.empty() && !fs::exists(parentDir)) {
-            fs::create_directories(parentDir);
-            std::println("Directories created: {}", parentDir.string());
+    std::uint32_t sum = 0;
+    int largest = 0;
+    for (int symbol = 0; symbol < static_cast<int>(counts.size()); ++symbol) {
+        if (counts[symbol] > 0) {
+            freq[symbol] = static_cast<std::uint16_t>(
+                std::max<std::uint64_t>(1, std::uint64_t(counts[symbol]) * kRansTotal / total));
+            sum += freq[symbol];
+            if (freq[symbol] > freq[largest]) {
+                largest = symbol;
+            }
+        }
+    }
+    if (sum < kRansTotal) {
+        freq[largest] = static_cast<std::uint16_t>(freq[largest] + kRansTotal - sum);
+    }
+    while (sum > kRansTotal) {
+        const auto top = std::max_element(freq.begin(), freq.end());
+        --*top;
+        --sum;
+    }
+    return freq;
+}
+
+inline void writeFrequencies(std::ostream& out, const RansFrequencies& freq) {
+    const auto symbolCount = static_cast<std::uint16_t>(
+        std::count_if(freq.begin(), freq.end(), [](std::uint16_t f) { return f > 0; }));
+    writeValue(out, symbolCount);
+    for (int symbol = 0; symbol < static_cast<int>(freq.size()); ++symbol) {
+        if (freq[symbol] > 0) {
+            writeValue(out, static_cast<std::uint8_t>(symbol));
+            writeValue(out, freq[symbol]);
         }
-    } catch (const fs::filesystem_error& e) {
-        std::cerr << "Error creating directories: " << e.what() << '\n';
-        return;
     }
+}
 
-    std::unordered_map<char, int> charFreq;
-    for (const auto& [frameNum, pixels] : video) {
-        for (const auto& [ch, color] : pixels) {
-            charFreq[ch]++;
+template <typename Input>
+inline bool readFrequencies(Input& in, RansFrequencies& freq) {
+    freq.fill(0);
+    std::uint16_t symbolCount;
+    if (!readValue(in, symbolCount) || symbolCount > freq.size()) {
+        return false;
+    }
+    std::uint32_t sum = 0;
+    for (int i = 0; i < symbolCount; ++i) {
+        std::uint8_t symbol;
+        std::uint16_t f;
+        if (!readValue(in, symbol) || !readValue(in, f) || f == 0 || f > kRansTotal) {
+            return false;
         }
+        freq[symbol] = f;
+        sum += f;
     }
+    // An unused context has no symbols; any other must cover the whole range
+    return symbolCount == 0 || sum == kRansTotal;
+}
 
-    Node* huffmanTree = buildHuffmanTree(charFreq);
-    std::unordered_map<char, std::string> huffmanCodes;
-    generateCodes(huffmanTree, "", huffmanCodes);
+// Cumulative starts for encoding plus a slot-to-symbol map for decoding
+struct RansTable {
+    RansFrequencies freq{};
+    std::array<std::uint16_t, 256> start{};
+    std::array<std::uint8_t, kRansTotal> symbolOf{};
+
+    RansTable() = default;
+
+    explicit RansTable(const RansFrequencies& frequencies) : freq(frequencies) {
+        std::uint32_t cumulative = 0;
+        for (int symbol = 0; symbol < static_cast<int>(freq.size()); ++symbol) {
+            start[symbol] = static_cast<std::uint16_t>(cumulative);
+            std::fill_n(symbolOf.begin() + cumulative, freq[symbol], static_cast<std::uint8_t>(symbol));
+            cumulative += freq[symbol];
+        }
+    }
+};
+
+
+inline void writeCell(BitWriter& bits, const Cell& cell, const HuffmanCodeTable& huffmanCodes) {
+    const HuffmanCode& code = huffmanCodes[static_cast<unsigned char>(cell.glyph)];
+    bits.writeBits(code.bits, code.length);
+    bits.writeBits(cell.r, 8);
+    bits.writeBits(cell.g, 8);
+    bits.writeBits(cell.b, 8);
+}
+
+// Colour channels are coded as their difference (mod 256) from the previous
+// cell in raster order of the frame being decoded, which is already known to
+// the decoder in both key and delta frames. The first cell predicts black.
+using ColourResidual = std::array<std::uint8_t, 3>;
+
+inline ColourResidual colourResidual(const Cell& cell, const Cell& predictor) {
+    return {static_cast<std::uint8_t>(cell.r - predictor.r),
+            static_cast<std::uint8_t>(cell.g - predictor.g),
+            static_cast<std::uint8_t>(cell.b - predictor.b)};
+}
+
+inline Cell applyResidual(Cell cell, const Cell& predictor, const ColourResidual& residual) {
+    cell.r = static_cast<std::uint8_t>(predictor.r + residual[0]);
+    cell.g = static_cast<std::uint8_t>(predictor.g + residual[1]);
+    cell.b = static_cast<std::uint8_t>(predictor.b + residual[2]);
+    return cell;
+}
+
+// Every entropy-coded symbol belongs to one context with its own 256-symbol
+// alphabet and statistics per segment. Channel contexts follow their base.
+enum SymbolContext : int {
+    kGlyphContext = 0,
+    kColourContext = 1,   // spatial residual, + channel
+    kTemporalContext = 4, // temporal residual, + channel
+    kPaletteContext = 7,  // palette slot + 1, or 0 for a literal cell
+    kContextCount = 8
+};
+
+using ContextCounts = std::array<SymbolCounts, kContextCount>;
+
+// Which cell codings a file uses, from its version and header flags
+struct CellCoding {
+    bool colour = true;    // v6+: colour residuals instead of raw channels
+    bool temporal = false; // kFlagTemporalColour
+    bool palette = false;  // kFlagPalette
+
+    // Table records carry statistics only for the contexts in use, in order
+    bool usesContext(int context) const {
+        if (context >= kPaletteContext) {
+            return palette;
+        }
+        if (context >= kTemporalContext) {
+            return temporal;
+        }
+        return context < kColourContext || colour;
+    }
+};
 
-    std::ofstream outFile(outPath, std::ios::binary);
+// The cell coders below are written against a symbol writer with
+//   void put(int context, std::uint8_t symbol);
+//   BitWriter& raw();                  // side bits: run lengths, repeat flags
+//   void writeTo(std::ostream& out);   // flushes one frame's payload
+// so the same walk over a frame feeds every entropy backend and the counter
+// that gathers its statistics.
+
+// Tallies symbols per context; raw bits are dropped
+class SymbolCounter {
+public:
+    void put(int context, std::uint8_t symbol) { counts[context][symbol]++; }
+    BitWriter& raw() { return bits; }
+    void writeTo(std::ostream&) { bits.clear(); }
+
+    const ContextCounts& result() const { return counts; }
+
+private:
+    ContextCounts counts{};
+    BitWriter bits;
+};
 
-    const int numFrames = static_cast<int>(video.size());
-    outFile.write(reinterpret_cast<const char*>(&numFrames), sizeof(numFrames));
-    writeHuffmanTree(outFile, huffmanTree);
+// Huffman backend. A v13 payload is byte-aligned sub-streams, each framed
+// like a v12 payload: the raw side bits, the colour and palette codes, then
+// kGlyphLanes lanes of glyph codes, glyph i going to lane i % kGlyphLanes.
+// Lanes share no bit position, so a decoder can follow them side by side.
+class HuffmanSymbolWriter {
+public:
+    explicit HuffmanSymbolWriter(const std::array<HuffmanCodeTable, kContextCount>& codes) : codes(codes) {}
 
-    std::vector<std::pair<char, rgb>> prevFrame;
-    for (int i = 0; i < numFrames; ++i) {
-        const auto& frame = video.at(i);
-        compressFrame(outFile, frame, huffmanCodes, i != 0, prevFrame);
-        prevFrame = frame;
+    void put(int context, std::uint8_t symbol) {
+        const HuffmanCode& code = codes[context][symbol];
+        BitWriter& stream = context == kGlyphContext ? streams[1 + glyphs++ % kGlyphLanes] : streams[0];
+        stream.writeBits(code.bits, code.length);
     }
+    BitWriter& raw() { return bits; }
+    void writeTo(std::ostream& out) {
+        writeBitStream(out, bits);
+        bits.clear();
+        for (BitWriter& stream : streams) {
+            writeBitStream(out, stream);
+            stream.clear();
+        }
+        glyphs = 0;
+    }
+
+private:
+    const std::array<HuffmanCodeTable, kContextCount>& codes;
+    BitWriter bits;
+    std::array<BitWriter, kHuffmanStreams> streams;
+    std::size_t glyphs = 0;
+};
 
-    std::println("Video compressed to: {}", outPath.string());
+// rANS backend. Symbols are buffered and coded in reverse when the frame is
+// flushed, so the decoder reads forwards. Payload: the raw side bitstream, then
+// int byte count and the rANS bytes, which open with both final states.
+class RansSymbolWriter {
+public:
+    explicit RansSymbolWriter(const std::array<RansTable, kContextCount>& tables) : tables(tables) {}
+
+    void put(int context, std::uint8_t symbol) { symbols.push_back({static_cast<std::uint8_t>(context), symbol}); }
+    BitWriter& raw() { return bits; }
+
+    void writeTo(std::ostream& out) {
+        writeBitStream(out, bits);
+        bits.clear();
+
+        bytes.clear();
+        std::array<std::uint32_t, kRansStates> state;
+        state.fill(kRansLowerBound);
+        for (std::size_t i = symbols.size(); i-- > 0;) {
+            const auto [context, symbol] = symbols[i];
+            const RansTable& table = tables[context];
+            const std::uint32_t freq = table.freq[symbol];
+            std::uint32_t& x = state[i % kRansStates];
+            const std::uint32_t xMax = ((kRansLowerBound >> kRansScaleBits) << 8) * freq;
+            while (x >= xMax) {
+                bytes.push_back(static_cast<std::uint8_t>(x));
+                x >>= 8;
+            }
+            x = ((x / freq) << kRansScaleBits) + (x % freq) + table.start[symbol];
+        }
+        // Bytes are emitted back to front; state 0 ends up first, little-endian
+        for (int s = kRansStates - 1; s >= 0; --s) {
+            for (int shift = 24; shift >= 0; shift -= 8) {
+                bytes.push_back(static_cast<std::uint8_t>(state[s] >> shift));
+            }
+        }
+        std::reverse(bytes.begin(), bytes.end());
+        symbols.clear();
+
+        writeValue(out, static_cast<int>(bytes.size()));
+        out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    }
+
+private:
+    struct Symbol {
+        std::uint8_t context;
+        std::uint8_t symbol;
+    };
+
+    const std::array<RansTable, kContextCount>& tables;
+    BitWriter bits;
+    std::vector<Symbol> symbols;
+    std::vector<std::uint8_t> bytes;
+};
+
+template <typename SymbolWriter>
+inline void writeResidual(SymbolWriter& symbols, int context, const ColourResidual& residual) {
+    for (int channel = 0; channel < 3; ++channel) {
+        symbols.put(context + channel, residual[channel]);
+    }
+}
+
+template <typename SymbolWriter>
+inline void writeCodedCell(SymbolWriter& symbols, const Cell& cell, const Cell& predictor) {
+    symbols.put(kGlyphContext, static_cast<std::uint8_t>(cell.glyph));
+    writeResidual(symbols, kColourContext, colourResidual(cell, predictor));
+}
+
+// Delta cell coded against the same cell of the previous frame. A zero bit
+// repeats the residual of the previous changed cell (a uniform colour drift, or
+// an unchanged colour); a one bit is followed by a new residual.
+template <typename SymbolWriter>
+inline void writeTemporalCell(SymbolWriter& symbols, const Cell& cell, const Cell& reference, ColourResidual& last) {
+    symbols.put(kGlyphContext, static_cast<std::uint8_t>(cell.glyph));
+    const ColourResidual residual = colourResidual(cell, reference);
+    if (residual == last) {
+        symbols.raw().writeBits(0, 1);
+        return;
+    }
+    symbols.raw().writeBits(1, 1);
+    writeResidual(symbols, kTemporalContext, residual);
+    last = residual;
+}
+
+// Recently coded (glyph, colour) tuples, one per hash slot, starting blank at
+// every frame. A cell found in its slot is coded as one joint symbol instead
+// of a glyph and three residuals; any other cell is coded as a literal and
+// replaces the slot.
+class CellPalette {
+public:
+    static constexpr int kSlots = 255;
+
+    template <typename SymbolWriter>
+    bool write(SymbolWriter& symbols, const Cell& cell) {
+        const int slot = slotOf(cell);
+        if (entries[slot] == cell) {
+            symbols.put(kPaletteContext, static_cast<std::uint8_t>(slot + 1));
+            return true;
+        }
+        symbols.put(kPaletteContext, 0);
+        entries[slot] = cell;
+        return false;
+    }
+
+    template <typename SymbolReader, typename ReadLiteral>
+    Cell read(SymbolReader& symbols, ReadLiteral&& readLiteral) {
+        const int symbol = symbols.get(kPaletteContext);
+        if (symbol > 0) {
+            return entries[symbol - 1];
+        }
+        const Cell cell = readLiteral();
+        entries[slotOf(cell)] = cell;
+        return cell;
+    }
+
+private:
+    static int slotOf(const Cell& cell) {
+        return (static_cast<unsigned char>(cell.glyph) * 11 + cell.r * 3 + cell.g * 5 + cell.b * 7) % kSlots;
+    }
+
+    std::array<Cell, kSlots> entries{};
+};
+
+// Delta frames can send their changed cells as masks of kTileSize x
+// kTileSize tiles, 16 bits each.
+constexpr int kTileSize = 4;
+
+// Bits of a tile that lie inside a width x height grid
+inline std::uint16_t tileValidMask(int width, int height, int tileX, int tileY) {
+    const int columns = std::min(kTileSize, width - tileX * kTileSize);
+    const int rows = std::min(kTileSize, height - tileY * kTileSize);
+    std::uint16_t mask = 0;
+    for (int r = 0; r < rows; ++r) {
+        mask = static_cast<std::uint16_t>(mask | ((1u << columns) - 1) << (r * kTileSize));
+    }
+    return mask;
+}
+
+// Changed cells of a frame against the previous one: a mask per tile, with
+// bit y * kTileSize + x for the cell at (x, y) in the tile, and one flag per
+// cell. A row equal to the previous frame's costs one memcmp; any other is
+// flagged cell by cell, as cheap as a plain compare, and each tile's row of
+// four flags is packed into its mask with one multiply.
+struct ChangeMap {
+    int width = 0;
+    int height = 0;
+    int tilesX = 0;
+    int tilesY = 0;
+    std::vector<std::uint16_t> tiles;
+    std::vector<std::uint8_t> cells;
+
+    ChangeMap() = default;
+
+    ChangeMap(ASCIIFrameView frame, ASCIIFrameView prev)
+        : width(frame.width), height(frame.height),
+          tilesX((frame.width + kTileSize - 1) / kTileSize), tilesY((frame.height + kTileSize - 1) / kTileSize),
+          tiles(static_cast<std::size_t>(tilesX) * tilesY), cells(frame.size()) {
+        if (prev.size() != frame.size()) {
+            for (int t = 0; t < static_cast<int>(tiles.size()); ++t) {
+                tiles[t] = validMask(t % tilesX, t / tilesX);
+            }
+            std::fill(cells.begin(), cells.end(), std::uint8_t{1});
+            return;
+        }
+        const int fullTiles = width / kTileSize;
+        for (int y = 0; y < height; ++y) {
+            const std::size_t base = static_cast<std::size_t>(y) * width;
+            const Cell* row = frame.cells.data() + base;
+            const Cell* prevRow = prev.cells.data() + base;
+            if (std::memcmp(row, prevRow, static_cast<std::size_t>(width) * sizeof(Cell)) == 0) {
+                continue;
+            }
+            std::uint8_t* flags = cells.data() + base;
+            for (int x = 0; x < width; ++x) {
+                flags[x] = std::bit_cast<std::uint32_t>(row[x]) != std::bit_cast<std::uint32_t>(prevRow[x]);
+            }
+
+            // Flag bytes 0-3 of a tile row land in bits 24-27 of the product
+            std::uint16_t* tileRow = &tiles[static_cast<std::size_t>(y / kTileSize) * tilesX];
+            const int shift = (y % kTileSize) * kTileSize;
+            for (int tx = 0; tx < fullTiles; ++tx) {
+                std::uint32_t word;
+                std::memcpy(&word, flags + tx * kTileSize, sizeof(word));
+                if constexpr (std::endian::native == std::endian::big) {
+                    word = std::byteswap(word);
+                }
+                tileRow[tx] = static_cast<std::uint16_t>(tileRow[tx] | ((word * 0x01020408u) >> 24) << shift);
+            }
+            if (fullTiles < tilesX) {
+                unsigned rowBits = 0;
+                for (int x = fullTiles * kTileSize; x < width; ++x) {
+                    rowBits |= unsigned{flags[x]} << (x - fullTiles * kTileSize);
+                }
+                tileRow[fullTiles] = static_cast<std::uint16_t>(tileRow[fullTiles] | rowBits << shift);
+            }
+        }
+    }
+
+    bool changed(std::size_t index) const { return cells[index] != 0; }
+
+    std::uint16_t validMask(int tileX, int tileY) const { return tileValidMask(width, height, tileX, tileY); }
+
+    // Tile map coding (v10): one bit per tile, then for each dirty tile a one
+    // bit if every cell in it changed, else a zero bit and its 16-bit mask
+    std::size_t tileMapBits() const {
+        std::size_t bits = tiles.size();
+        for (std::size_t t = 0; t < tiles.size(); ++t) {
+            if (tiles[t] != 0) {
+                bits += tiles[t] == validMask(static_cast<int>(t % tilesX), static_cast<int>(t / tilesX)) ? 1 : 17;
+            }
+        }
+        return bits;
+    }
+
+    void writeTileMap(BitWriter& bits) const {
+        for (const std::uint16_t mask : tiles) {
+            bits.writeBits(mask != 0, 1);
+        }
+        for (std::size_t t = 0; t < tiles.size(); ++t) {
+            if (tiles[t] == 0) {
+                continue;
+            }
+            if (tiles[t] == validMask(static_cast<int>(t % tilesX), static_cast<int>(t / tilesX))) {
+                bits.writeBits(1, 1);
+            } else {
+                bits.writeBits(0, 1);
+                bits.writeBits(tiles[t], 16);
+            }
+        }
+    }
+};
+
+// Reads a tile map into `tiles` and lists the changed cells in raster order
+inline void readTileMap(BitReader& bits, int width, int height, std::vector<std::uint16_t>& tiles,
+                        std::vector<std::uint32_t>& changed) {
+    const int tilesX = (width + kTileSize - 1) / kTileSize;
+    const int tilesY = (height + kTileSize - 1) / kTileSize;
+    tiles.resize(static_cast<std::size_t>(tilesX) * tilesY);
+    for (std::uint16_t& mask : tiles) {
+        mask = static_cast<std::uint16_t>(bits.readBits(1));
+    }
+    for (std::size_t t = 0; t < tiles.size(); ++t) {
+        if (tiles[t] == 0) {
+            continue;
+        }
+        const std::uint16_t valid = tileValidMask(width, height, static_cast<int>(t % tilesX), static_cast<int>(t / tilesX));
+        tiles[t] = bits.readBits(1) ? valid : static_cast<std::uint16_t>(bits.readBits(16));
+        if ((tiles[t] & ~valid) != 0) {
+            throw std::runtime_error("Tile mask outside the grid");
+        }
+    }
+
+    changed.clear();
+    for (int y = 0; y < height; ++y) {
+        const int shift = (y % kTileSize) * kTileSize;
+        const std::uint16_t* row = &tiles[static_cast<std::size_t>(y / kTileSize) * tilesX];
+        for (int tx = 0; tx < tilesX; ++tx) {
+            for (unsigned rowBits = (row[tx] >> shift) & 0xFu; rowBits != 0; rowBits &= rowBits - 1) {
+                changed.push_back(static_cast<std::uint32_t>(y * width + tx * kTileSize + std::countr_zero(rowBits)));
+            }
+        }
+    }
+}
+
+// Pans are searched up to this many cells each way. A delta frame with at
+// least 1 / kPanSearchShare of its cells changed looks for one.
+constexpr int kMaxPanX = 8;
+constexpr int kMaxPanY = 4;
+constexpr std::size_t kPanSearchShare = 4;
+
+// Moves every cell of a grid by (dx, dy) in place; cells the move uncovers at
+// the edges keep their old values
+inline void shiftCells(std::span<Cell> cells, int width, int dx, int dy) {
+    const int height = width > 0 ? static_cast<int>(cells.size() / width) : 0;
+    const int columns = width - std::abs(dx);
+    if (columns <= 0 || std::abs(dy) >= height) {
+        return;
+    }
+    // Rows are moved away from the direction of travel, so each source row is
+    // read before it is overwritten
+    for (int i = 0; i < height - std::abs(dy); ++i) {
+        const int y = dy > 0 ? height - 1 - i : i;
+        std::memmove(&cells[static_cast<std::size_t>(y) * width + std::max(0, dx)],
+                     &cells[static_cast<std::size_t>(y - dy) * width + std::max(0, -dx)], columns * sizeof(Cell));
+    }
+}
+
+// The pan (dx, dy) of the previous frame that best predicts this one, or
+// (0, 0) when none halves the cells that differ. Scored on every fourth row,
+// once a pass over every sixteenth shows the shift cuts the cells that differ
+// there by at least a quarter; most shifts of a frame that did not pan stop
+// at that pass.
+inline std::pair<int, int> findPan(ASCIIFrameView frame, ASCIIFrameView prev) {
+    const auto mismatches = [&](int dx, int dy, int rowStep, std::size_t limit) {
+        std::size_t count = 0;
+        for (int y = 0; y < frame.height && count < limit; y += rowStep) {
+            const bool rowInside = y - dy >= 0 && y - dy < frame.height;
+            for (int x = 0; x < frame.width; ++x) {
+                const bool inside = rowInside && x - dx >= 0 && x - dx < frame.width;
+                count += frame.at(x, y) != (inside ? prev.at(x - dx, y - dy) : prev.at(x, y));
+            }
+        }
+        return count;
+    };
+
+    const std::size_t still = mismatches(0, 0, 4, std::numeric_limits<std::size_t>::max());
+    const std::size_t probeLimit = mismatches(0, 0, 16, std::numeric_limits<std::size_t>::max()) * 3 / 4 + 1;
+    std::pair<int, int> best{0, 0};
+    std::size_t bestCount = still / 2;
+    for (int dy = -kMaxPanY; dy <= kMaxPanY; ++dy) {
+        for (int dx = -kMaxPanX; dx <= kMaxPanX; ++dx) {
+            if ((dx == 0 && dy == 0) || mismatches(dx, dy, 16, probeLimit) >= probeLimit) {
+                continue;
+            }
+            const std::size_t count = mismatches(dx, dy, 4, bestCount);
+            if (count < bestCount) {
+                best = {dx, dy};
+                bestCount = count;
+            }
+        }
+    }
+    return best;
+}
+
+// The pan to code a delta frame with: findPan's when at least
+// 1 / kPanSearchShare of the cells changed, else (0, 0)
+inline std::pair<int, int> choosePan(ASCIIFrameView frame, ASCIIFrameView prev) {
+    if (prev.size() != frame.size()) {
+        return {0, 0};
+    }
+    const std::size_t limit = (frame.size() + kPanSearchShare - 1) / kPanSearchShare;
+    std::size_t changes = 0;
+    for (std::size_t i = 0; i < frame.size() && changes < limit; ++i) {
+        changes += frame[i] != prev[i];
+    }
+    return changes >= limit ? findPan(frame, prev) : std::pair{0, 0};
+}
+
+template <typename SymbolWriter>
+inline void writeDeltaCell(SymbolWriter& symbols, const CellCoding& coding, ASCIIFrameView frame,
+                           ASCIIFrameView prevFrame, std::size_t c, CellPalette& palette, ColourResidual& lastResidual) {
+    if (coding.palette && palette.write(symbols, frame[c])) {
+        return;
+    }
+    if (coding.temporal) {
+        writeTemporalCell(symbols, frame[c], c < prevFrame.size() ? prevFrame[c] : Cell{}, lastResidual);
+    } else {
+        writeCodedCell(symbols, frame[c], c > 0 ? frame[c - 1] : Cell{});
+    }
+}
+
+// Codes the cells of one frame and returns how many it coded. Key frames code
+// every cell. Delta frames open with a pan bit; when `pan` is not (0, 0), the
+// bit is set and the previous frame moves by it, sent as zigzag Exp-Golomb dx
+// and dy, before the changes against it apply.
+// The changed cells then follow in raster order behind a bit choosing how
+// their positions are sent, whichever is smaller:
+//   0: runs, each an Exp-Golomb gap since the previous run ended and its
+//      length minus one, followed by its cells
+//   1: a tile map, then every changed cell
+template <typename SymbolWriter>
+inline int writeFrameCells(SymbolWriter& symbols, ASCIIFrameView frame, bool useDelta, ASCIIFrameView prevFrame,
+                           const CellCoding& coding, std::pair<int, int> pan = {0, 0}) {
+    CellPalette palette;
+    if (!useDelta) {
+        for (std::size_t i = 0; i < frame.size(); ++i) {
+            if (!coding.palette || !palette.write(symbols, frame[i])) {
+                writeCodedCell(symbols, frame[i], i > 0 ? frame[i - 1] : Cell{});
+            }
+        }
+        return static_cast<int>(frame.size());
+    }
+
+    ASCIIFrame panned;
+    const auto zigzag = [](int value) { return static_cast<std::uint32_t>(value) << 1 ^ static_cast<std::uint32_t>(value >> 31); };
+    symbols.raw().writeBits(pan != std::pair{0, 0}, 1);
+    if (pan != std::pair{0, 0}) {
+        symbols.raw().writeExpGolomb(zigzag(pan.first));
+        symbols.raw().writeExpGolomb(zigzag(pan.second));
+        panned = ASCIIFrame(frame.width, frame.height, std::vector<Cell>(prevFrame.cells.begin(), prevFrame.cells.end()));
+        shiftCells(panned.cells, panned.width, pan.first, pan.second);
+        prevFrame = panned;
+    }
+    const ChangeMap map(frame, prevFrame);
+
+    const auto expGolombBits = [](std::size_t value) { return 2 * std::bit_width(value + 1) - 1; };
+    std::vector<std::pair<std::size_t, std::size_t>> runs;
+    std::size_t runBits = 0;
+    int numChanges = 0;
+    for (std::size_t i = 0; i < frame.size(); ++i) {
+        if (!map.changed(i)) {
+            continue;
+        }
+        std::size_t end = i + 1;
+        while (end < frame.size() && map.changed(end)) {
+            ++end;
+        }
+        runBits += expGolombBits(i - (runs.empty() ? 0 : runs.back().second)) + expGolombBits(end - i - 1);
+        runs.emplace_back(i, end);
+        numChanges += static_cast<int>(end - i);
+        i = end;
+    }
+
+    ColourResidual lastResidual{};
+    const bool tileMap = map.tileMapBits() < runBits;
+    symbols.raw().writeBits(tileMap, 1);
+    if (tileMap) {
+        map.writeTileMap(symbols.raw());
+    }
+    std::size_t runEnd = 0;
+    for (const auto& [begin, end] : runs) {
+        if (!tileMap) {
+            symbols.raw().writeExpGolomb(static_cast<std::uint32_t>(begin - runEnd));
+            symbols.raw().writeExpGolomb(static_cast<std::uint32_t>(end - begin - 1));
+        }
+        for (std::size_t c = begin; c < end; ++c) {
+            writeDeltaCell(symbols, coding, frame, prevFrame, c, palette, lastResidual);
+        }
+        runEnd = end;
+    }
+    return numChanges;
+}
+
+template <typename SymbolWriter>
+inline void compressFrame(std::ostream& out,
+                         ASCIIFrameView frame,
+                         SymbolWriter& symbols,
+                         bool useDelta,
+                         ASCIIFrameView prevFrame,
+                         const CellCoding& coding = {},
+                         std::pair<int, int> pan = {0, 0}) {
+    const int numChanges = writeFrameCells(symbols, frame, useDelta, prevFrame, coding, pan);
+
+    if (!useDelta) {
+        // The grid size is in the file header
+        writeValue(out, FrameType::Key);
+    } else {
+        writeValue(out, FrameType::Delta);
+        writeValue(out, numChanges);
+    }
+    symbols.writeTo(out);
+}
+
+static Cell parsePixel(const HuffmanDecoder& decoder, BitReader& bits) {
+    Cell cell;
+    cell.glyph = decoder.decode(bits);
+    cell.r = static_cast<std::uint8_t>(bits.readBits(8));
+    cell.g = static_cast<std::uint8_t>(bits.readBits(8));
+    cell.b = static_cast<std::uint8_t>(bits.readBits(8));
+    return cell;
+}
+
+// v1 cells prefix every code with its length in 8 bits
+static Cell parseLegacyPixel(const HuffmanDecoder& decoder, BitReader& bits) {
+    const std::size_t codeLen = bits.readBits(8);
+    const std::size_t codeStart = bits.position();
+    Cell cell;
+    cell.glyph = decoder.decode(bits);
+    if (bits.position() - codeStart != codeLen) {
+        throw std::runtime_error("Huffman code length mismatch");
+    }
+    cell.r = static_cast<std::uint8_t>(bits.readBits(8));
+    cell.g = static_cast<std::uint8_t>(bits.readBits(8));
+    cell.b = static_cast<std::uint8_t>(bits.readBits(8));
+    return cell;
+}
+
+// Symbol readers mirror the writers:
+//   std::uint8_t get(int context);
+//   BitReader& raw();
+//   bool overrun() const;
+class HuffmanSymbolReader {
+public:
+    HuffmanSymbolReader(const std::array<HuffmanDecoder, kContextCount>& decoders,
+                        std::span<const std::uint8_t> bytes, int bitCount)
+        : decoders(decoders), bits(bytes, bitCount) {}
+
+    std::uint8_t get(int context) { return static_cast<std::uint8_t>(decoders[context].decode(bits)); }
+    BitReader& raw() { return bits; }
+    bool overrun() const { return bits.overrun(); }
+
+private:
+    const std::array<HuffmanDecoder, kContextCount>& decoders;
+    BitReader bits;
+};
+
+// v13 split payload. Given the frame's glyph count, known whenever cells
+// are not palette coded, every glyph is decoded up front with the lanes
+// advanced in lockstep; otherwise glyphs are read from the lanes on demand.
+// One fill of 56 bits covers kGlyphsPerFill table lookups of at most
+// kHuffmanLookupBits each.
+class SplitHuffmanSymbolReader {
+public:
+    SplitHuffmanSymbolReader(const std::array<HuffmanDecoder, kContextCount>& decoders,
+                             std::span<const std::uint8_t> rawBytes, int bitCount,
+                             const std::array<std::span<const std::uint8_t>, kHuffmanStreams>& streamBytes,
+                             const std::array<int, kHuffmanStreams>& streamBits, std::vector<char>& glyphs,
+                             int glyphCount)
+        : decoders(decoders), bits(rawBytes, bitCount), colours(streamBytes[0], streamBits[0]), glyphs(glyphs),
+          batched(glyphCount >= 0) {
+        for (int lane = 0; lane < kGlyphLanes; ++lane) {
+            lanes[lane] = BitReader(streamBytes[1 + lane], streamBits[1 + lane]);
+        }
+        if (!batched) {
+            return;
+        }
+        const HuffmanDecoder& decoder = decoders[kGlyphContext];
+        glyphs.resize(static_cast<std::size_t>(glyphCount));
+        for (std::size_t i = decodeGlyphs(decoder, glyphs); i < glyphs.size(); ++i) {
+            glyphs[i] = decoder.decode(lanes[i % kGlyphLanes]);
+        }
+    }
+
+    std::uint8_t get(int context) {
+        if (context != kGlyphContext) {
+            return static_cast<std::uint8_t>(decoders[context].decode(colours));
+        }
+        const std::size_t i = nextGlyph++;
+        if (!batched) {
+            return static_cast<std::uint8_t>(decoders[kGlyphContext].decode(lanes[i % kGlyphLanes]));
+        }
+        return i < glyphs.size() ? static_cast<std::uint8_t>(glyphs[i]) : 0;
+    }
+
+    BitReader& raw() { return bits; }
+    bool overrun() const {
+        return bits.overrun() || colours.overrun() || (batched && nextGlyph > glyphs.size()) ||
+               std::ranges::any_of(lanes, [](const BitReader& lane) { return lane.overrun(); });
+    }
+
+private:
+    static constexpr int kGlyphsPerFill = 56 / kHuffmanLookupBits;
+
+    // Decodes whole groups of kGlyphsPerFill glyphs per lane until the end or
+    // the first long code, returning how many glyphs it decoded. The lanes
+    // are copied out so they stay in registers; stores to the glyphs would
+    // otherwise force them back to memory after every symbol.
+    std::size_t decodeGlyphs(const HuffmanDecoder& decoder, std::vector<char>& out) {
+        constexpr std::size_t kGroup = kGlyphsPerFill * kGlyphLanes;
+        std::array<BitReader, kGlyphLanes> local = lanes;
+        char* glyph = out.data();
+        std::size_t i = 0;
+        for (; i + kGroup <= out.size(); i += kGroup) {
+            for (BitReader& lane : local) {
+                lane.fill();
+            }
+            for (std::size_t k = 0; k < kGroup; ++k) {
+                if (!decoder.decodeFilled(local[k % kGlyphLanes], glyph[i + k])) {
+                    lanes = local;
+                    return i + k;
+                }
+            }
+        }
+        lanes = local;
+        return i;
+    }
+
+    const std::array<HuffmanDecoder, kContextCount>& decoders;
+    BitReader bits;
+    BitReader colours;
+    std::array<BitReader, kGlyphLanes> lanes;
+    std::vector<char>& glyphs;
+    bool batched;
+    std::size_t nextGlyph = 0;
+};
+
+// Reads past the end of the rANS bytes stop renormalising and are reported
+// through overrun()
+class RansSymbolReader {
+public:
+    RansSymbolReader(const std::array<RansTable, kContextCount>& tables, std::span<const std::uint8_t> rawBytes,
+                     int bitCount, std::span<const std::uint8_t> ransBytes)
+        : tables(tables), bits(rawBytes, bitCount), data(ransBytes.data()), end(ransBytes.data() + ransBytes.size()) {
+        for (std::uint32_t& x : state) {
+            x = 0;
+            for (int shift = 0; shift < 32; shift += 8) {
+                x |= std::uint32_t{readByte()} << shift;
+            }
+        }
+    }
+
+    std::uint8_t get(int context) {
+        const RansTable& table = tables[context];
+        std::uint32_t& x = state[next++ % kRansStates];
+        const std::uint32_t slot = x & (kRansTotal - 1);
+        const std::uint8_t symbol = table.symbolOf[slot];
+        x = table.freq[symbol] * (x >> kRansScaleBits) + slot - table.start[symbol];
+        while (x < kRansLowerBound && !exhausted) {
+            x = (x << 8) | readByte();
+        }
+        return symbol;
+    }
+
+    BitReader& raw() { return bits; }
+    bool overrun() const { return exhausted || bits.overrun(); }
+
+private:
+    std::uint8_t readByte() {
+        if (data == end) {
+            exhausted = true;
+            return 0;
+        }
+        return *data++;
+    }
+
+    const std::array<RansTable, kContextCount>& tables;
+    BitReader bits;
+    const std::uint8_t* data;
+    const std::uint8_t* end;
+    std::array<std::uint32_t, kRansStates> state{};
+    std::size_t next = 0;
+    bool exhausted = false;
+};
+
+template <typename SymbolReader>
+inline ColourResidual readResidual(SymbolReader& symbols, int context) {
+    return {symbols.get(context), symbols.get(context + 1), symbols.get(context + 2)};
+}
+
+// Before v6 colours are raw 8-bit channels after the glyph
+template <typename SymbolReader>
+inline Cell readCodedCell(SymbolReader& symbols, const Cell& predictor, bool colourCoded) {
+    Cell cell;
+    cell.glyph = static_cast<char>(symbols.get(kGlyphContext));
+    if (!colourCoded) {
+        cell.r = static_cast<std::uint8_t>(symbols.raw().readBits(8));
+        cell.g = static_cast<std::uint8_t>(symbols.raw().readBits(8));
+        cell.b = static_cast<std::uint8_t>(symbols.raw().readBits(8));
+        return cell;
+    }
+    return applyResidual(cell, predictor, readResidual(symbols, kColourContext));
+}
+
+// Mirrors writeTemporalCell; the repeat bit skips the residual
+template <typename SymbolReader>
+inline Cell readTemporalCell(SymbolReader& symbols, const Cell& reference, ColourResidual& last) {
+    Cell cell;
+    cell.glyph = static_cast<char>(symbols.get(kGlyphContext));
+    if (symbols.raw().readBits(1)) {
+        last = readResidual(symbols, kTemporalContext);
+    }
+    return applyResidual(cell, reference, last);
+}
+
+// v3+ key frame: every cell of an already sized frame
+template <typename SymbolReader>
+inline void decodeKeyFrame(SymbolReader& symbols, const CellCoding& coding, std::span<Cell> cells) {
+    CellPalette palette;
+    for (std::size_t i = 0; i < cells.size(); ++i) {
+        const auto readLiteral = [&] { return readCodedCell(symbols, i > 0 ? cells[i - 1] : Cell{}, coding.colour); };
+        cells[i] = coding.palette ? palette.read(symbols, readLiteral) : readLiteral();
+    }
+    if (symbols.overrun()) {
+        throw std::runtime_error("Frame data overrun");
+    }
+}
+
+// Fills every cell of an already sized frame
+inline void decodeFullFrame(const HuffmanDecoder& decoder, std::span<const std::uint8_t> frameBytes,
+                            int bitCount, bool legacy, std::span<Cell> cells) {
+    BitReader bits(frameBytes, bitCount);
+
+    for (Cell& cell : cells) {
+        cell = legacy ? parseLegacyPixel(decoder, bits) : parsePixel(decoder, bits);
+    }
+    if (bits.overrun()) {
+        throw std::runtime_error("Frame data overrun");
+    }
+}
+
+// Applies a delta payload of absolute 32-bit indices (v1-v4) and records the
+// index of every cell it wrote
+inline void applyDeltaFrame(const HuffmanDecoder& decoder, std::span<const std::uint8_t> frameBytes,
+                            int bitCount, int numChanges, bool legacy, std::span<Cell> cells,
+                            std::vector<std::uint32_t>& changed) {
+    BitReader bits(frameBytes, bitCount);
+
+    changed.clear();
+    for (int c = 0; c < numChanges; c++) {
+        // Parse changed pixel
+        const std::size_t index = bits.readBits(32);
+
+        if (index >= cells.size()) {
+            std::cerr << "ERROR: Index " << index << " out of bounds (frame size: " << cells.size() << ")\n";
+            throw std::out_of_range("Index out of bounds");
+        }
+
+        cells[index] = legacy ? parseLegacyPixel(decoder, bits) : parsePixel(decoder, bits);
+        changed.push_back(static_cast<std::uint32_t>(index));
+    }
+    if (bits.overrun()) {
+        throw std::runtime_error("Frame data overrun");
+    }
+}
+
+// One changed cell of a delta frame; cells[index] still holds the previous
+// frame's value
+template <typename SymbolReader>
+inline Cell readDeltaCell(SymbolReader& symbols, const CellCoding& coding, std::span<const Cell> cells,
+                          std::size_t index, CellPalette& palette, ColourResidual& lastResidual) {
+    const auto readLiteral = [&] {
+        return coding.temporal ? readTemporalCell(symbols, cells[index], lastResidual)
+                               : readCodedCell(symbols, index > 0 ? cells[index - 1] : Cell{}, coding.colour);
+    };
+    return coding.palette ? palette.read(symbols, readLiteral) : readLiteral();
+}
+
+// v5+ delta payload: runs of changed cells, each an Exp-Golomb gap from the end
+// of the previous run and length minus one, followed by the run's cells
+template <typename SymbolReader>
+inline void applyRunDeltaFrame(SymbolReader& symbols, const CellCoding& coding, int numChanges,
+                               std::span<Cell> cells, std::vector<std::uint32_t>& changed) {
+    BitReader& bits = symbols.raw();
+
+    changed.clear();
+    std::size_t index = 0;
+    ColourResidual lastResidual{};
+    CellPalette palette;
+    while (changed.size() < static_cast<std::size_t>(numChanges)) {
+        index += bits.readExpGolomb();
+        const std::size_t runLength = std::size_t{bits.readExpGolomb()} + 1;
+        if (index + runLength > cells.size() || changed.size() + runLength > static_cast<std::size_t>(numChanges)) {
+            std::cerr << "ERROR: Run at " << index << " of " << runLength << " cells out of bounds (frame size: "
+                      << cells.size() << ")\n";
+            throw std::out_of_range("Index out of bounds");
+        }
+        for (const std::size_t end = index + runLength; index < end; ++index) {
+            cells[index] = readDeltaCell(symbols, coding, cells, index, palette, lastResidual);
+            changed.push_back(static_cast<std::uint32_t>(index));
+        }
+        if (symbols.overrun()) {
+            throw std::runtime_error("Frame data overrun");
+        }
+    }
+}
+
+// v10 tile map delta payload: the map, then every changed cell in raster order
+template <typename SymbolReader>
+inline void applyTileDeltaFrame(SymbolReader& symbols, const CellCoding& coding, int numChanges, int width,
+                                std::span<Cell> cells, std::vector<std::uint16_t>& tiles,
+                                std::vector<std::uint32_t>& changed) {
+    const int height = width > 0 ? static_cast<int>(cells.size() / width) : 0;
+    readTileMap(symbols.raw(), width, height, tiles, changed);
+    if (changed.size() != static_cast<std::size_t>(numChanges) || symbols.overrun()) {
+        throw std::runtime_error("Tile map does not match the change count");
+    }
+
+    ColourResidual lastResidual{};
+    CellPalette palette;
+    for (const std::uint32_t index : changed) {
+        cells[index] = readDeltaCell(symbols, coding, cells, index, palette, lastResidual);
+    }
+    if (symbols.overrun()) {
+        throw std::runtime_error("Frame data overrun");
+    }
+}
+
+// v1 and v2 files store frames as text, with a '\n' cell closing every row.
+// Rebuilds the grid, padding short rows with blank cells.
+inline ASCIIFrame frameFromTextLayout(const std::vector<Cell>& text) {
+    int width = 0;
+    int height = 0;
+    int column = 0;
+    for (const Cell& cell : text) {
+        if (cell.glyph == '\n') {
+            width = std::max(width, column);
+            column = 0;
+            ++height;
+        } else {
+            ++column;
+        }
+    }
+    if (column > 0) {
+        width = std::max(width, column);
+        ++height;
+    }
+
+    ASCIIFrame frame(width, height);
+    int x = 0;
+    int y = 0;
+    for (const Cell& cell : text) {
+        if (cell.glyph == '\n') {
+            x = 0;
+            ++y;
+        } else {
+            frame.at(x++, y) = cell;
+        }
+    }
+    return frame;
+}
+
+// Pull-style decoder: reads one record per next() call and reconstructs it in a
+// single working frame, so memory stays constant however long the file is.
+//
+// v1: int numframes, pre-order tree, then frame 0 in full and a delta per frame,
+// each payload followed by a remainder byte.
+// v2+: magic, version, flags and frame count, then tagged records. v2 and v3
+// carry one set of code lengths after the header; v4 sends them in table
+// records instead. v2 key frames hold a text-layout cell count; v3-v8 key frames
+// hold the grid width and height. v5 delta frames code changed cells as runs
+// instead of absolute indices; v6 table records add colour residual codes; v7
+// headers name the entropy coder, and rANS frames follow their side bitstream
+// with the rANS bytes; v8 adds kFlagPalette. v9 headers carry the grid size
+// and frame rate after the frame count, and key frames no longer repeat it.
+// v10 delta frames send their changed positions as runs or as a tile map;
+// v11 delta frames may pan the previous frame before their changes apply;
+// v12 adds Reference and Keep records, which restore the working frame from
+// and save it to one of kReferenceSlots slots. v13 Huffman frames split
+// their codes into colour and glyph lane sub-streams.
+// Files written with kFlagSeekIndex end with a keyframe index that seek() uses
+// to start decoding at the nearest key frame; kFlagTemporalColour files code
+// delta colours against the previous frame.
+//
+// open(), next() and seek() throw std::runtime_error on malformed data.
+class ASCIIVideoDecoder {
+public:
+    // A quiet decoder skips the per-file and per-frame progress log
+    explicit ASCIIVideoDecoder(bool verbose = true) : verbose(verbose) {}
+
+    bool open(const std::string& inPathStr) {
+        const fs::path inPath(inPathStr);
+        if (inPath.extension() != ".bin" || !fs::exists(inPath)) {
+            std::cerr << "This file does not exist or is not a bin file: " << inPathStr << '\n';
+            return false;
+        }
+
+        if (!file.open(inPath)) {
+            std::cerr << "Failed to open file: " << inPath.string() << '\n';
+            return false;
+        }
+        packedBits = ByteReader(file.bytes());
+        if (verbose) {
+            std::println("Start Decompressing from: {}", inPath.string());
+        }
+
+        framesRead = 0;
+        haveTable = false;
+        coder = EntropyCoder::Huffman;
+        coding = CellCoding{false};
+        runCoding = coding;
+        current = ASCIIFrame();
+        fps = 0.0f;
+        changed.clear();
+        clearSlots();
+        lastOutput = nullptr;
+
+        std::array<char, 4> magic;
+        if (!readValue(packedBits, magic)) {
+            throw std::runtime_error("Truncated file header");
+        }
+        if (magic == kFileMagic) {
+            readHeader();
+        } else {
+            // No magic: the first four bytes are the v1 frame count
+            std::memcpy(&numFrames, magic.data(), sizeof(int));
+            readLegacyHeader();
+        }
+        firstRecord = packedBits.tell();
+        headerHasTable = haveTable;
+        return true;
+    }
+
+    // Positions the decoder so that the next call to next() yields `frame`.
+    // Decoding restarts at the closest key frame at or before it, or at the
+    // start of the file when there is no index.
+    bool seek(int frame) {
+        if (!file.is_open() || frame < 0 || frame >= numFrames) {
+            return false;
+        }
+        const auto after = std::upper_bound(seekIndex.begin(), seekIndex.end(), frame,
+                                            [](int f, const SeekEntry& entry) { return f < entry.frame; });
+        const SeekEntry* key = after == seekIndex.begin() ? nullptr : &*std::prev(after);
+        if (frame < framesRead || (key && key->frame > framesRead)) {
+            clearSlots();
+            if (key) {
+                packedBits.seek(static_cast<std::size_t>(key->offset));
+                framesRead = key->frame;
+                haveTable = false;
+            } else {
+                packedBits.seek(firstRecord);
+                framesRead = 0;
+                haveTable = headerHasTable;
+            }
+        }
+        while (framesRead < frame) {
+            next();
+        }
+        return true;
+    }
+
+    // Decodes the next frame; false once every frame has been read
+    bool next() {
+        if (!file.is_open() || framesRead >= numFrames) {
+            return false;
+        }
+        if (verbose) {
+            std::println("Decompressing frame {}/{}", framesRead, numFrames - 1);
+        }
+        if (version == 1) {
+            readLegacyFrame();
+        } else {
+            readFrame();
+        }
+        ++framesRead;
+        return true;
+    }
+
+    // Decodes the next frame into `cells`, which must hold width() * height()
+    // cells, and lists the cells that changed in `changedCells`, reusing the
+    // capacity of both. Passing the buffer of the previous call, unmodified,
+    // copies only the changed cells; frames where keyFrame() is true leave
+    // `changedCells` empty and copy every cell.
+    bool next(std::span<Cell> cells, std::vector<std::uint32_t>& changedCells) {
+        const bool inSync = cells.data() == lastOutput && lastOutputFrame == frameIndex();
+        if (!next()) {
+            return false;
+        }
+        if (cells.size() != current.size()) {
+            throw std::runtime_error("Output buffer does not match the grid");
+        }
+        if (key) {
+            changedCells.clear();
+        } else {
+            changedCells.assign(changed.begin(), changed.end());
+        }
+        if (key || !inSync) {
+            std::ranges::copy(current.cells, cells.begin());
+        } else {
+            for (const std::uint32_t index : changed) {
+                cells[index] = current[index];
+            }
+        }
+        lastOutput = cells.data();
+        lastOutputFrame = frameIndex();
+        return true;
+    }
+
+    void close() {
+        packedBits = ByteReader();
+        file.close();
+    }
+
+    int frameCount() const { return numFrames; }
+    int frameIndex() const { return framesRead - 1; }
+
+    // Grid size and frame rate from a v9+ header. Older files have no frame
+    // rate, and their grid size is only known once the first frame is read.
+    int width() const { return current.width; }
+    int height() const { return current.height; }
+    float framesPerSecond() const { return fps; }
+    ASCIIFrameView frame() const { return current; }
+
+    // True when every cell of frame() may have changed: key frames, panned
+    // deltas, deltas against a reference slot, and legacy deltas that moved a
+    // row break
+    bool keyFrame() const { return key; }
+
+    // Indices into frame() of the cells the last delta wrote
+    std::span<const std::uint32_t> changedCells() const { return changed; }
+
+    // Key frames listed in the seek index, in frame order; empty without one
+    std::span<const SeekEntry> keyFrames() const { return seekIndex; }
+
+private:
+    // Slots are empty at a seek point; emptied ones keep their memory
+    void clearSlots() {
+        for (ASCIIFrame& slot : slots) {
+            slot.cells.clear();
+        }
+    }
+
+    void readHeader() {
+        std::uint16_t flags;
+        if (!readValue(packedBits, version) || !readValue(packedBits, flags)) {
+            throw std::runtime_error("Truncated file header");
+        }
+        if (version < kMinFormatVersion || version > kFormatVersion) {
+            throw std::runtime_error("Unsupported format version " + std::to_string(version));
+        }
+        if (version >= 7 && !readValue(packedBits, coder)) {
+            throw std::runtime_error("Truncated file header");
+        }
+        if (coder != EntropyCoder::Huffman && coder != EntropyCoder::Rans) {
+            throw std::runtime_error("Unknown entropy coder " + std::to_string(static_cast<int>(coder)));
+        }
+        if (!readValue(packedBits, numFrames)) {
+            throw std::runtime_error("Truncated file header");
+        }
+        if (version >= 9) {
+            int columns, rows;
+            if (!readValue(packedBits, columns) || !readValue(packedBits, rows) || !readValue(packedBits, fps)) {
+                throw std::runtime_error("Truncated file header");
+            }
+            if (!validGridSize(columns, rows)) {
+                throw std::runtime_error("Invalid grid size");
+            }
+            current = ASCIIFrame(columns, rows);
+        }
+        textLayout = version < 3;
+        coding.colour = version >= 6;
+        coding.temporal = version >= 6 && (flags & kFlagTemporalColour);
+        coding.palette = version >= 8 && (flags & kFlagPalette);
+        if (verbose) {
+            std::println("Format v{}, {} coder, number of frames: {}, grid {}x{}", version,
+                         coder == EntropyCoder::Rans ? "rANS" : "Huffman", numFrames, current.width, current.height);
+        }
+
+        if (version < 4) {
+            readTable();
+        }
+        seekIndex.clear();
+        if (flags & kFlagSeekIndex) {
+            readSeekIndex();
+        }
+    }
+
+    void readSeekIndex() {
+        const auto start = static_cast<std::int64_t>(packedBits.tell());
+        std::int64_t indexOffset;
+        int count;
+        const auto end = static_cast<std::int64_t>(packedBits.size()) - static_cast<std::int64_t>(sizeof(indexOffset));
+        if (end < start || !packedBits.seek(static_cast<std::size_t>(end)) || !readValue(packedBits, indexOffset) ||
+            indexOffset < start || indexOffset > end || !packedBits.seek(static_cast<std::size_t>(indexOffset)) ||
+            !readValue(packedBits, count) || count < 0 ||
+            static_cast<std::size_t>(count) > packedBits.remaining() / (sizeof(int) + sizeof(std::int64_t))) {
+            throw std::runtime_error("Invalid seek index");
+        }
+
+        seekIndex.resize(count);
+        for (SeekEntry& entry : seekIndex) {
+            if (!readValue(packedBits, entry.frame) || !readValue(packedBits, entry.offset) ||
+                entry.frame < 0 || entry.frame >= numFrames || entry.offset < start || entry.offset >= indexOffset ||
+                (&entry != seekIndex.data() && entry.frame <= (&entry - 1)->frame)) {
+                throw std::runtime_error("Invalid seek index");
+            }
+        }
+        packedBits.seek(static_cast<std::size_t>(start));
+        if (verbose) {
+            std::println("Seek index loaded: {} key frames", count);
+        }
+    }
+
+    void readLegacyHeader() {
+        version = 1;
+        textLayout = true;
+        if (verbose) {
+            std::println("Legacy v1 file, number of frames: {}", numFrames);
+        }
+
+        Node* huffmanTree = readHuffmanTree(packedBits);
+        if (!huffmanTree) {
+            throw std::runtime_error("Failed to read Huffman tree");
+        }
+        // The tree is only needed to derive the codes for the lookup table
+        HuffmanCodeTable huffmanCodes{};
+        generateCodes(huffmanTree, 0, 0, huffmanCodes);
+        deleteHuffmanTree(huffmanTree);
+        huffmanDecoders[kGlyphContext] = HuffmanDecoder(huffmanCodes);
+        haveTable = true;
+        if (verbose) {
+            std::println("Huffman tree loaded");
+        }
+    }
+
+    // Glyph statistics, then colour (v6+) and temporal contexts in order
+    // An empty palette table turns the palette off until the next table.
+    void readTable() {
+        runCoding = coding;
+        for (int context = 0; context < kContextCount; ++context) {
+            if (!coding.usesContext(context)) {
+                continue;
+            }
+            bool empty;
+            if (coder == EntropyCoder::Rans) {
+                RansFrequencies freq;
+                if (!readFrequencies(packedBits, freq)) {
+                    throw std::runtime_error("Invalid rANS frequencies");
+                }
+                ransTables[context] = RansTable(freq);
+                empty = std::ranges::all_of(freq, [](std::uint16_t f) { return f == 0; });
+            } else {
+                CodeLengths lengths;
+                if (!readCodeLengths(packedBits, lengths)) {
+                    throw std::runtime_error("Invalid Huffman code lengths");
+                }
+                huffmanDecoders[context].assign(buildCanonicalCodes(lengths));
+                empty = std::ranges::all_of(lengths, [](std::uint8_t length) { return length == 0; });
+            }
+            if (context == kPaletteContext && empty) {
+                runCoding.palette = false;
+            }
+        }
+        haveTable = true;
+        if (verbose) {
+            std::println("Symbol statistics loaded");
+        }
+    }
+
+    void readLegacyFrame() {
+        int count, bitCount;
+        if (!readValue(packedBits, count) || !readValue(packedBits, bitCount) || count < 0 ||
+            !readBitStream(packedBits, bitCount, frameBytes, true)) {
+            throw std::runtime_error("Truncated frame data");
+        }
+
+        if (framesRead == 0) {
+            if (verbose) {
+                std::println("  Frame 0: frameSize={}, bitCount={}", count, bitCount);
+            }
+            text.resize(count);
+            decodeFullFrame(huffmanDecoders[kGlyphContext], frameBytes, bitCount, true, text);
+            if (verbose) {
+                std::println("  Frame 0 reconstructed with {} pixels", text.size());
+            }
+            layoutText();
+        } else {
+            if (verbose) {
+                std::println("  Delta frame: {} changes, {} bits", count, bitCount);
+            }
+            applyDeltaFrame(huffmanDecoders[kGlyphContext], frameBytes, bitCount, count, true, text, changed);
+            applyTextChanges();
+        }
+    }
+
+    void readFrame() {
+        FrameType type;
+        if (!readValue(packedBits, type)) {
+            throw std::runtime_error("Truncated frame data");
+        }
+        // Table records, and from v12 reference slot records, come before the
+        // frame they apply to
+        bool restored = false;
+        for (;;) {
+            if (type == FrameType::Table && version >= 4) {
+                readTable();
+            } else if ((type == FrameType::Reference || type == FrameType::Keep) && version >= 12) {
+                std::uint8_t slot;
+                if (!readValue(packedBits, slot) || slot >= kReferenceSlots) {
+                    throw std::runtime_error("Invalid reference slot");
+                }
+                if (type == FrameType::Keep) {
+                    slots[slot] = current;
+                } else if (slots[slot].cells.empty()) {
+                    throw std::runtime_error("Reference to an empty slot");
+                } else {
+                    current = slots[slot];
+                    restored = true;
+                }
+            } else {
+                break;
+            }
+            if (!readValue(packedBits, type)) {
+                throw std::runtime_error("Truncated frame data");
+            }
+        }
+        if (!haveTable) {
+            throw std::runtime_error("Frame before Huffman code lengths");
+        }
+
+        int width = current.width, height = current.height;
+        if (type == FrameType::Key) {
+            // A v2 key frame is one text-layout row of `width` cells
+            if (version < 9 && (!readValue(packedBits, width) || (!textLayout && !readValue(packedBits, height)))) {
+                throw std::runtime_error("Truncated frame data");
+            }
+            if (!validGridSize(width, textLayout ? 1 : height)) {
+                throw std::runtime_error("Invalid grid size");
+            }
+            // The first key frame decoded, which a seek may have skipped to, sizes the grid
+            if (!textLayout && !current.cells.empty() && (width != current.width || height != current.height)) {
+                throw std::runtime_error("Grid size changed mid-video");
+            }
+        } else if (type != FrameType::Delta || framesRead == 0) {
+            throw std::runtime_error("Invalid frame type");
+        }
+
+        int count = 0, bitCount;
+        if ((type == FrameType::Delta && !readValue(packedBits, count)) || !readValue(packedBits, bitCount) ||
+            !readBitStream(packedBits, bitCount, frameBytes)) {
+            throw std::runtime_error("Truncated frame data");
+        }
+        int ransSize;
+        if (coder == EntropyCoder::Rans && (!readValue(packedBits, ransSize) || ransSize < 0 ||
+                                            !packedBits.view(static_cast<std::size_t>(ransSize), ransBytes))) {
+            throw std::runtime_error("Truncated frame data");
+        }
+        std::int64_t payloadBits = bitCount;
+        if (coder == EntropyCoder::Huffman && version >= 13) {
+            for (int stream = 0; stream < kHuffmanStreams; ++stream) {
+                if (!readValue(packedBits, streamBits[stream]) ||
+                    !readBitStream(packedBits, streamBits[stream], streamBytes[stream])) {
+                    throw std::runtime_error("Truncated frame data");
+                }
+                payloadBits += streamBits[stream];
+            }
+        }
+
+        // v3+ frames decode straight into the working frame; v2 frames go through a text buffer
+        if (type == FrameType::Key) {
+            if (verbose) {
+                std::println("  Key frame: {}x{}, bitCount={}", width, height, payloadBits);
+            }
+            if (textLayout) {
+                text.assign(width, Cell{});
+                decodeFullFrame(huffmanDecoders[kGlyphContext], frameBytes, bitCount, false, text);
+                layoutText();
+            } else {
+                if (current.cells.empty()) {
+                    current = ASCIIFrame(width, height);
+                }
+                withSymbolReader(bitCount, static_cast<int>(current.size()), [&](auto& symbols) {
+                    decodeKeyFrame(symbols, runCoding, current.cells);
+                });
+                key = true;
+                changed.clear();
+            }
+        } else {
+            if (verbose) {
+                std::println("  Delta frame: {} changes, {} bits", count, payloadBits);
+            }
+            if (textLayout) {
+                applyDeltaFrame(huffmanDecoders[kGlyphContext], frameBytes, bitCount, count, false, text, changed);
+                applyTextChanges();
+            } else if (version >= 5) {
+                // v11 deltas open with a pan of the previous frame, which
+                // moves every cell, then v10+ with a bit choosing runs or a
+                // tile map
+                key = false;
+                const auto applyDelta = [&](auto& symbols) {
+                    BitReader& bits = symbols.raw();
+                    if (version >= 11 && bits.readBits(1)) {
+                        const auto unzigzag = [](std::uint32_t value) {
+                            return static_cast<int>(value >> 1) ^ -static_cast<int>(value & 1);
+                        };
+                        const int dx = unzigzag(bits.readExpGolomb());
+                        const int dy = unzigzag(bits.readExpGolomb());
+                        if (std::abs(dx) >= current.width || std::abs(dy) >= current.height) {
+                            throw std::runtime_error("Pan larger than the grid");
+                        }
+                        shiftCells(current.cells, current.width, dx, dy);
+                        key = true;
+                    }
+                    if (version >= 10 && symbols.raw().readBits(1)) {
+                        applyTileDeltaFrame(symbols, runCoding, count, current.width, current.cells, tiles, changed);
+                    } else {
+                        applyRunDeltaFrame(symbols, runCoding, count, current.cells, changed);
+                    }
+                };
+                if (count < 0 || static_cast<std::size_t>(count) > current.size()) {
+                    throw std::runtime_error("Invalid change count");
+                }
+                withSymbolReader(bitCount, count, applyDelta);
+            } else {
+                applyDeltaFrame(huffmanDecoders[kGlyphContext], frameBytes, bitCount, count, false, current.cells, changed);
+                key = false;
+            }
+        }
+        key = key || restored;
+    }
+
+    // Runs decode with the reader for the current frame's payload, which
+    // codes glyphCount cells
+    template <typename Decode>
+    void withSymbolReader(int bitCount, int glyphCount, Decode&& decode) {
+        if (coder == EntropyCoder::Rans) {
+            RansSymbolReader symbols(ransTables, frameBytes, bitCount, ransBytes);
+            decode(symbols);
+        } else if (version >= 13) {
+            SplitHuffmanSymbolReader symbols(huffmanDecoders, frameBytes, bitCount, streamBytes, streamBits, glyphs,
+                                             runCoding.palette ? -1 : glyphCount);
+            decode(symbols);
+        } else {
+            HuffmanSymbolReader symbols(huffmanDecoders, frameBytes, bitCount);
+            decode(symbols);
+        }
+    }
+
+    // Rebuilds the working frame from the text buffer and maps every text cell
+    // to its grid index, or -1 for row breaks
+    void layoutText() {
+        current = frameFromTextLayout(text);
+        textToGrid.resize(text.size());
+        int x = 0, y = 0;
+        for (std::size_t i = 0; i < text.size(); ++i) {
+            if (text[i].glyph == '\n') {
+                textToGrid[i] = -1;
+                x = 0;
+                ++y;
+            } else {
+                textToGrid[i] = y * current.width + x++;
+            }
+        }
+        key = true;
+        changed.clear();
+    }
+
+    // Moves the text cells a delta wrote into the grid, relaying out the whole
+    // frame if a row break was added or removed
+    void applyTextChanges() {
+        for (const std::uint32_t index : changed) {
+            if (textToGrid[index] < 0 || text[index].glyph == '\n') {
+                layoutText();
+                return;
+            }
+        }
+        for (std::uint32_t& index : changed) {
+            const int gridIndex = textToGrid[index];
+            current.cells[gridIndex] = text[index];
+            index = static_cast<std::uint32_t>(gridIndex);
+        }
+        key = false;
+    }
+
+    bool verbose;
+    MappedFile file;
+    ByteReader packedBits;
+    std::size_t firstRecord = 0;
+    bool headerHasTable = false;
+    std::vector<SeekEntry> seekIndex;
+    std::uint16_t version = 0;
+    bool textLayout = false;
+    int numFrames = 0;
+    float fps = 0.0f;
+    int framesRead = 0;
+    EntropyCoder coder = EntropyCoder::Huffman;
+    CellCoding coding{false};
+    CellCoding runCoding{false};
+    std::array<HuffmanDecoder, kContextCount> huffmanDecoders;
+    std::array<RansTable, kContextCount> ransTables;
+    bool haveTable = false;
+    // Views into the file of the current frame's payload
+    std::span<const std::uint8_t> frameBytes;
+    std::span<const std::uint8_t> ransBytes;
+    std::array<std::span<const std::uint8_t>, kHuffmanStreams> streamBytes;
+    std::array<int, kHuffmanStreams> streamBits{};
+    std::vector<char> glyphs;
+    std::vector<Cell> text;
+    std::vector<int> textToGrid;
+    ASCIIFrame current;
+    std::array<ASCIIFrame, kReferenceSlots> slots;
+    bool key = false;
+    std::vector<std::uint32_t> changed;
+    std::vector<std::uint16_t> tiles;
+    // Buffer and frame of the last next(cells, changedCells) call
+    const Cell* lastOutput = nullptr;
+    int lastOutputFrame = -1;
+};
+
+// Decodes the key frame groups that overlap firstFrame..lastFrame on worker
+// threads, each with its own decoder, into the matching preallocated frames of
+// `video`. Workers pull groups from a shared counter.
+inline void decodeGroupsParallel(const std::string& inPathStr, std::span<const SeekEntry> keyFrames, int numFrames,
+                                 int firstFrame, int lastFrame, int threads, ASCIIVideo& video) {
+    std::atomic<std::size_t> nextGroup{0};
+    std::exception_ptr failure;
+    std::mutex failureMutex;
+
+    auto worker = [&] {
+        try {
+            ASCIIVideoDecoder decoder(false);
+            if (!decoder.open(inPathStr)) {
+                throw std::runtime_error("Failed to reopen " + inPathStr);
+            }
+            std::vector<std::uint32_t> changed;
+            for (std::size_t group; (group = nextGroup++) < keyFrames.size();) {
+                const int groupEnd = group + 1 < keyFrames.size() ? keyFrames[group + 1].frame : numFrames;
+                const int begin = std::max(keyFrames[group].frame, firstFrame);
+                const int end = std::min(groupEnd, lastFrame + 1);
+                if (begin >= end) {
+                    continue;
+                }
+                if (!decoder.seek(begin)) {
+                    throw std::runtime_error("Failed to seek to frame " + std::to_string(begin));
+                }
+                for (int f = begin; f < end; ++f) {
+                    if (!decoder.next(video.frameCells(f - firstFrame), changed)) {
+                        throw std::runtime_error("Frame group ends before frame " + std::to_string(f));
+                    }
+                }
+            }
+        } catch (...) {
+            std::lock_guard lock(failureMutex);
+            if (!failure) {
+                failure = std::current_exception();
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int t = 1; t < threads; ++t) {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (std::thread& thread : workers) {
+        thread.join();
+    }
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+}
+
+// Decodes frames firstFrame..lastFrame inclusive; lastFrame < 0 means through
+// the end of the file. Files with more than one indexed key frame are decoded a
+// group at a time on up to `threads` threads (0 uses every hardware thread).
+inline ASCIIVideo decompressASCIIVideo(const std::string& inPathStr, int firstFrame = 0, int lastFrame = -1,
+                                       int threads = 0) {
+    ASCIIVideo video;
+
+    try {
+        ASCIIVideoDecoder decoder;
+        if (!decoder.open(inPathStr)) {
+            return video;
+        }
+        if (lastFrame < 0 || lastFrame >= decoder.frameCount()) {
+            lastFrame = decoder.frameCount() - 1;
+        }
+        if (decoder.frameCount() > 0 && (firstFrame > lastFrame || !decoder.seek(firstFrame))) {
+            std::cerr << "Frame range " << firstFrame << ".." << lastFrame << " is empty or out of bounds\n";
+            return video;
+        }
+        if (threads <= 0) {
+            threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        }
+        threads = std::min<int>(threads, static_cast<int>(decoder.keyFrames().size()));
+
+        if (threads > 1 && decoder.next()) {
+            // The first frame only sizes the preallocated store
+            const ASCIIFrameView frame = decoder.frame();
+            video = ASCIIVideo(frame.width, frame.height);
+            video.resize(lastFrame - firstFrame + 1);
+            std::println("Decoding {} frames on {} threads", video.size(), threads);
+            decodeGroupsParallel(inPathStr, decoder.keyFrames(), decoder.frameCount(), firstFrame, lastFrame,
+                                 threads, video);
+        } else {
+            while (decoder.frameIndex() < lastFrame && decoder.next()) {
+                const ASCIIFrameView frame = decoder.frame();
+                if (video.empty()) {
+                    video = ASCIIVideo(frame.width, frame.height);
+                    video.reserve(lastFrame - firstFrame + 1);
+                }
+                video.push_back(frame);
+            }
+        }
+
+        std::println("Video decompressed successfully: {} frames", video.size());
+        
+    } catch (const std::exception& e) {
+        std::cerr << "Exception during decompression: " << e.what() << '\n';
+        return ASCIIVideo{};
+    }
+
+    return video;
+}
+
+// Lossy delta threshold. A delta cell that keeps its glyph and whose colour is
+// within tolerance of what the decoder already shows is not sent; the shown
+// value stands, so errors are bounded and never accumulate.
+struct ChangeTolerance {
+    // Largest absolute difference per channel (R, G, B); all zero skips this test
+    std::array<int, 3> channel{};
+    // Largest sum of channel differences weighted by luma (BT.601); 0 skips this test
+    int luma = 0;
+
+    bool lossless() const { return channel == std::array<int, 3>{} && luma == 0; }
+
+    bool accepts(const Cell& cell, const Cell& shown) const {
+        if (lossless() || cell.glyph != shown.glyph) {
+            return false;
+        }
+        const int dr = std::abs(cell.r - shown.r);
+        const int dg = std::abs(cell.g - shown.g);
+        const int db = std::abs(cell.b - shown.b);
+        const bool perChannel = channel != std::array<int, 3>{};
+        return (!perChannel || (dr <= channel[0] && dg <= channel[1] && db <= channel[2])) &&
+               (luma == 0 || 77 * dr + 150 * dg + 29 * db <= luma * 256);
+    }
+};
+
+struct EncoderOptions {
+    // Frames buffered per Huffman table
+    int segmentFrames = 64;
+    // Most frames between seek points; 0 adds none beyond frame 0 and scene cuts
+    int keyFrameInterval = 64;
+    // Segments encoded concurrently; 0 uses every hardware thread
+    int threads = 0;
+    // Code delta frame colours against the previous frame (kFlagTemporalColour)
+    bool temporalColour = false;
+    // Code cells repeated within a frame as palette slots (kFlagPalette)
+    bool palette = false;
+    // Delta frames drop changes within this tolerance; the default is lossless
+    ChangeTolerance tolerance = {};
+    // Frame rate recorded in the header; 0 when unknown
+    float fps = 0.0f;
+    // Huffman decodes fastest; rANS gets closer to the entropy on skewed alphabets
+    EntropyCoder entropyCoder = EntropyCoder::Huffman;
+    // A frame whose estimated cost under the current table exceeds its own
+    // entropy by this fraction (plus the price of a table) starts a new table
+    // mid-segment; 0 keeps one table per segment
+    double tableDrift = 0.1;
+    // Make scene cuts seek points, and code any frame a key makes smaller
+    // than a delta as a key
+    bool adaptiveKeyFrames = true;
+    // Keep frames that open a shot in reference slots, and code a frame that
+    // returns to one against it instead of the previous frame
+    bool referenceFrames = true;
+};
+
+// Estimated bits to code `data` with a model fitted to `model`. Symbols the
+// model has not seen are charged as if seen half a time.
+inline double estimateCodingBits(const SymbolCounts& model, const SymbolCounts& data) {
+    double modelTotal = 0.5;
+    for (int count : model) {
+        modelTotal += count;
+    }
+    double bits = 0.0;
+    for (int symbol = 0; symbol < static_cast<int>(data.size()); ++symbol) {
+        if (data[symbol] > 0) {
+            const double modelCount = model[symbol] > 0 ? model[symbol] : 0.5;
+            bits -= data[symbol] * std::log2(modelCount / modelTotal);
+        }
+    }
+    return bits;
+}
+
+// Estimated bits to code `counts` with a table fitted to them: the code
+// lengths for Huffman, the entropy for rANS
+inline double estimateTableBits(const SymbolCounts& counts, EntropyCoder coder) {
+    if (coder == EntropyCoder::Rans) {
+        return estimateCodingBits(counts, counts);
+    }
+    const CodeLengths lengths = buildCodeLengths(counts);
+    double bits = 0.0;
+    for (int symbol = 0; symbol < static_cast<int>(counts.size()); ++symbol) {
+        bits += static_cast<double>(counts[symbol]) * lengths[symbol];
+    }
+    return bits;
+}
+
+// True when coding `frame` with the statistics gathered in `current` costs
+// more than `drift` above the frame's own entropy plus a fresh table
+inline bool statisticsDrifted(const ContextCounts& current, const ContextCounts& frame, double drift) {
+    double ownBits = 0.0, currentBits = 0.0, tableBits = 0.0;
+    for (int context = 0; context < kContextCount; ++context) {
+        ownBits += estimateCodingBits(frame[context], frame[context]);
+        currentBits += estimateCodingBits(current[context], frame[context]);
+        // A table entry is a symbol byte and a one- or two-byte length or frequency
+        tableBits += 24.0 * std::ranges::count_if(frame[context], [](int count) { return count > 0; });
+    }
+    return currentBits - ownBits > drift * ownBits + tableBits;
+}
+
+// A delta frame with fewer than 1 / kKeyCheckShare of its cells changed in
+// place stays a delta without costing the alternative
+constexpr std::size_t kKeyCheckShare = 2;
+// Frames whose cell histograms differ by at least this share of their cells
+// are a scene cut
+constexpr double kSceneCutDistance = 0.5;
+
+// Estimated bits to code a frame's cells: its raw bits and its symbols under
+// a table fitted to them
+inline double estimateFrameBits(ASCIIFrameView frame, bool useDelta, ASCIIFrameView prevFrame,
+                                const CellCoding& coding, EntropyCoder coder, std::pair<int, int> pan = {0, 0}) {
+    SymbolCounter counter;
+    writeFrameCells(counter, frame, useDelta, prevFrame, coding, pan);
+    double bits = static_cast<double>(counter.raw().bitCount());
+    for (const SymbolCounts& counts : counter.result()) {
+        bits += estimateTableBits(counts, coder);
+    }
+    return bits;
+}
+
+// Share of the cells that would have to change to turn one frame's histogram
+// of glyphs and brightness quarters into the other's
+inline double cellHistogramDistance(ASCIIFrameView a, ASCIIFrameView b) {
+    std::vector<int> histogram(256 * 4);
+    const auto bin = [](const Cell& cell) {
+        return static_cast<std::uint8_t>(cell.glyph) * 4 + (77 * cell.r + 150 * cell.g + 29 * cell.b) / (256 * 64);
+    };
+    for (const Cell& cell : a.cells) {
+        histogram[bin(cell)]++;
+    }
+    for (const Cell& cell : b.cells) {
+        histogram[bin(cell)]--;
+    }
+    std::size_t moved = 0;
+    for (const int count : histogram) {
+        moved += static_cast<std::size_t>(std::abs(count));
+    }
+    return a.size() > 0 ? static_cast<double>(moved) / (2.0 * static_cast<double>(a.size())) : 0.0;
+}
+
+// FNV-1a over a frame's cells, to spot repeats of kept frames
+inline std::uint64_t frameHash(ASCIIFrameView frame) {
+    std::uint64_t hash = 14695981039346656037ull;
+    for (const Cell& cell : frame.cells) {
+        hash = (hash ^ std::bit_cast<std::uint32_t>(cell)) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// Incremental encoder: frames are pushed one at a time and written out a
+// segment at a time, each segment preceded by a table record built from its own
+// symbol counts, with further table records where the statistics drift. Seek
+// points (frame 0, the key frame interval and scene cuts) are key frames that
+// open a new segment, so seeking to one finds its table. Other frames are
+// coded as keys inside their segment where that is smaller than a delta.
+// Frames that open a shot are kept in reference slots, and a later frame
+// closer to a kept one than to its predecessor is coded against it.
+//
+// Up to `threads` segments are buffered and encoded in parallel into separate
+// buffers, then written in order, so the file is identical for any thread
+// count. Memory is bounded by threads * segmentFrames frames.
+class ASCIIVideoEncoder {
+public:
+    explicit ASCIIVideoEncoder(EncoderOptions options = {}) : options(options) {
+        this->options.segmentFrames = std::max(1, this->options.segmentFrames);
+        this->options.keyFrameInterval = std::max(0, this->options.keyFrameInterval);
+        if (this->options.threads <= 0) {
+            this->options.threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        }
+        segments.resize(this->options.threads);
+        segmentPlans.resize(this->options.threads);
+        encoded.resize(this->options.threads);
+    }
+
+    ~ASCIIVideoEncoder() {
+        if (outFile.is_open()) {
+            finish();
+        }
+    }
+
+    ASCIIVideoEncoder(const ASCIIVideoEncoder&) = delete;
+    ASCIIVideoEncoder& operator=(const ASCIIVideoEncoder&) = delete;
+
+    bool open(const std::string& outPathStr) {
+        outPath = outPathStr;
+        fs::path parentDir = outPath.parent_path();
+
+        if (!outPath.has_extension()) {
+            outPath.replace_extension(".bin");
+        }
+
+        try {
+            if (!parentDir.empty() && !fs::exists(parentDir)) {
+                fs::create_directories(parentDir);
+                std::println("Directories created: {}", parentDir.string());
+            }
+        } catch (const fs::filesystem_error& e) {
+            std::cerr << "Error creating directories: " << e.what() << '\n';
+            return false;
+        }
+
+        outFile.open(outPath, std::ios::binary | std::ios::trunc);
+        if (!outFile.is_open()) {
+            std::cerr << "Failed to open file: " << outPath.string() << '\n';
+            return false;
+        }
+
+        // The frame count and grid size are patched in by finish()
+        writeValue(outFile, kFileMagic);
+        writeValue(outFile, kFormatVersion);
+        writeValue(outFile, static_cast<std::uint16_t>(kFlagSeekIndex | (options.temporalColour ? kFlagTemporalColour : 0) |
+                                                       (options.palette ? kFlagPalette : 0)));
+        writeValue(outFile, options.entropyCoder);
+        frameCountPos = outFile.tellp();
+        writeValue(outFile, 0);
+        writeValue(outFile, 0);
+        writeValue(outFile, 0);
+        writeValue(outFile, options.fps);
+
+        framesWritten = 0;
+        framesPending = 0;
+        activeSegment = 0;
+        seekIndex.clear();
+        lastSeekPoint = 0;
+        references = {};
+        shotCount = 0;
+        prevFrame = ASCIIFrame();
+        shown = ASCIIFrame();
+        return true;
+    }
+
+    bool pushFrame(ASCIIFrameView frame) {
+        if (!outFile.is_open()) {
+            std::cerr << "Encoder is not open\n";
+            return false;
+        }
+        if (frameCount() == 0) {
+            if (!validGridSize(frame.width, frame.height)) {
+                std::cerr << "Frame size " << frame.width << "x" << frame.height << " is larger than the format allows\n";
+                return false;
+            }
+            for (ASCIIVideo& segment : segments) {
+                segment = ASCIIVideo(frame.width, frame.height);
+                segment.reserve(options.segmentFrames);
+            }
+        } else if (frame.width != segments[0].width() || frame.height != segments[0].height()) {
+            std::cerr << "Frame size " << frame.width << "x" << frame.height << " does not match the video\n";
+            return false;
+        }
+
+        // A frame that returns to a kept one is coded against it; otherwise a
+        // large change is a scene cut, or a key where that is smaller. A cut
+        // back to a shot seen before is not a seek point, which would empty
+        // the slots the shots around it return to.
+        const int index = frameCount();
+        FramePlan plan;
+        bool panChosen = false;
+        bool seekPoint = index == 0 || (options.keyFrameInterval > 0 && index - lastSeekPoint >= options.keyFrameInterval);
+        const bool newShot = !seekPoint && largelyChanged(frame);
+        if (newShot) {
+            const std::uint64_t hash = frameHash(frame);
+            plan.reference = options.referenceFrames ? findReference(frame, hash) : -1;
+            if (plan.reference < 0 && options.adaptiveKeyFrames) {
+                seekPoint = cellHistogramDistance(frame, lastFrame()) >= kSceneCutDistance &&
+                            !(options.referenceFrames && seenShot(hash));
+                if (!seekPoint) {
+                    plan.pan = choosePan(frame, lastFrame());
+                    panChosen = true;
+                    plan.key = keyIsSmaller(frame, plan.pan);
+                }
+            }
+        }
+        plan.key = plan.key || seekPoint;
+        plan.seekPoint = seekPoint;
+        if (seekPoint) {
+            lastSeekPoint = index;
+            references = {};
+            if (!segments[activeSegment].empty()) {
+                closeSegment();
+            }
+        }
+        if (plan.reference >= 0) {
+            plan.base = references[plan.reference].frame;
+            references[plan.reference].lastUsed = index;
+            references[plan.reference].used = true;
+        }
+        if (plan.key) {
+            plan.pan = {0, 0};
+        } else if (!panChosen) {
+            plan.pan = choosePan(frame, plan.base ? ASCIIFrameView(*plan.base) : lastFrame());
+        }
+
+        if (options.tolerance.lossless()) {
+            segments[activeSegment].push_back(frame);
+        } else {
+            // Buffer what the decoder will show rather than the source. Key
+            // frames are exact; delta cells within tolerance keep the shown value.
+            if (plan.key) {
+                shown = ASCIIFrame(frame.width, frame.height, std::vector<Cell>(frame.cells.begin(), frame.cells.end()));
+            } else {
+                if (plan.base) {
+                    shown = *plan.base;
+                }
+                for (std::size_t i = 0; i < frame.size(); ++i) {
+                    if (!options.tolerance.accepts(frame[i], shown[i])) {
+                        shown[i] = frame[i];
+                    }
+                }
+            }
+            segments[activeSegment].push_back(shown);
+        }
+        if (options.referenceFrames && plan.reference < 0 && (seekPoint || newShot)) {
+            plan.store = keepReference(segments[activeSegment][segments[activeSegment].size() - 1], index);
+        }
+        segmentPlans[activeSegment].push_back(std::move(plan));
+        ++framesPending;
+        if (static_cast<int>(segments[activeSegment].size()) >= options.segmentFrames) {
+            closeSegment();
+        }
+        return static_cast<bool>(outFile);
+    }
+
+    bool finish() {
+        if (!outFile.is_open()) {
+            return false;
+        }
+        flushSegments();
+
+        const std::int64_t indexOffset = outFile.tellp();
+        writeValue(outFile, static_cast<int>(seekIndex.size()));
+        for (const SeekEntry& entry : seekIndex) {
+            writeValue(outFile, entry.frame);
+            writeValue(outFile, entry.offset);
+        }
+        writeValue(outFile, indexOffset);
+
+        outFile.seekp(frameCountPos);
+        writeValue(outFile, framesWritten);
+        writeValue(outFile, segments[0].width());
+        writeValue(outFile, segments[0].height());
+        const bool ok = static_cast<bool>(outFile);
+        outFile.close();
+        std::println("Video compressed to: {}", outPath.string());
+        return ok;
+    }
+
+    int frameCount() const { return framesWritten + framesPending; }
+
+private:
+    // How a buffered frame is coded
+    struct FramePlan {
+        bool key = false;
+        // Whether decoding can start here: a key with the reference slots emptied
+        bool seekPoint = false;
+        // Slot the frame is coded against instead of the frame before it, or -1
+        int reference = -1;
+        // Slot the frame is kept in once decoded, or -1
+        int store = -1;
+        // The reference slot's frame
+        std::shared_ptr<const ASCIIFrame> base;
+        // How a delta shifts the frame it is coded against, found once here
+        // rather than on every sizing pass
+        std::pair<int, int> pan{0, 0};
+    };
+
+    struct ReferenceSlot {
+        std::uint64_t hash = 0;
+        std::shared_ptr<const ASCIIFrame> frame;
+        int lastUsed = 0;
+        // Whether a frame has been coded against it
+        bool used = false;
+    };
+
+    static CellCoding cellCoding(const EncoderOptions& options) {
+        return {true, options.temporalColour, options.palette};
+    }
+
+    // The frame buffered last, or the one before the buffers when they are empty
+    ASCIIFrameView lastFrame() const {
+        for (std::size_t k = activeSegment + 1; k-- > 0;) {
+            if (!segments[k].empty()) {
+                return segments[k][segments[k].size() - 1];
+            }
+        }
+        return prevFrame;
+    }
+
+    // Cells that differ by more than the tolerance, counted a row at a time
+    // until `limit` is reached
+    std::size_t countChanges(ASCIIFrameView frame, ASCIIFrameView base, std::size_t limit) const {
+        std::size_t changes = 0;
+        for (std::size_t row = 0; row < frame.size() && changes < limit; row += frame.width) {
+            for (std::size_t i = row; i < row + frame.width; ++i) {
+                changes += frame[i] != base[i] && !options.tolerance.accepts(frame[i], base[i]);
+            }
+        }
+        return changes;
+    }
+
+    // True when at least 1 / kKeyCheckShare of the cells changed in place
+    bool largelyChanged(ASCIIFrameView frame) const {
+        const std::size_t limit = (frame.size() + kKeyCheckShare - 1) / kKeyCheckShare;
+        return countChanges(frame, lastFrame(), limit) >= limit;
+    }
+
+    // The reference slot holding this frame, or else the one it differs from
+    // least if that is under 1 / kKeyCheckShare of the cells; -1 for none
+    int findReference(ASCIIFrameView frame, std::uint64_t hash) const {
+        int best = -1;
+        std::size_t bestChanges = frame.size() / kKeyCheckShare;
+        for (int slot = 0; slot < kReferenceSlots; ++slot) {
+            const ReferenceSlot& reference = references[slot];
+            if (!reference.frame) {
+                continue;
+            }
+            if (reference.hash == hash && ASCIIFrameView(*reference.frame) == frame) {
+                return slot;
+            }
+            const std::size_t changes = countChanges(frame, *reference.frame, bestChanges);
+            if (changes < bestChanges) {
+                best = slot;
+                bestChanges = changes;
+            }
+        }
+        return best;
+    }
+
+    bool seenShot(std::uint64_t hash) const {
+        const auto historyEnd = shotHistory.begin() + static_cast<std::ptrdiff_t>(std::min(shotCount, kShotHistory));
+        return std::find(shotHistory.begin(), historyEnd, hash) != historyEnd;
+    }
+
+    // Keeps a frame that opens a shot in an empty slot. Once the slots are
+    // full, only a shot seen before replaces one, and only a slot no frame
+    // has referenced yet, the oldest first; evicting slots in use makes a
+    // loop longer than the slots miss on every frame. Returns the slot, or -1.
+    int keepReference(ASCIIFrameView frame, int index) {
+        const std::uint64_t hash = frameHash(frame);
+        const bool seenBefore = seenShot(hash);
+        shotHistory[shotCount++ % kShotHistory] = hash;
+
+        auto slot = std::ranges::find_if(references, [](const ReferenceSlot& reference) { return !reference.frame; });
+        if (slot == references.end() && seenBefore) {
+            slot = std::ranges::min_element(references, {}, [](const ReferenceSlot& reference) {
+                return reference.used ? std::numeric_limits<int>::max() : reference.lastUsed;
+            });
+            slot = slot->used ? references.end() : slot;
+        }
+        if (slot == references.end()) {
+            return -1;
+        }
+        *slot = {hash, std::make_shared<const ASCIIFrame>(frame.width, frame.height,
+                                                          std::vector<Cell>(frame.cells.begin(), frame.cells.end())),
+                 index, false};
+        return static_cast<int>(slot - references.begin());
+    }
+
+    bool keyIsSmaller(ASCIIFrameView frame, std::pair<int, int> pan) const {
+        const CellCoding coding = cellCoding(options);
+        return estimateFrameBits(frame, false, {}, coding, options.entropyCoder) <=
+               estimateFrameBits(frame, true, lastFrame(), coding, options.entropyCoder, pan);
+    }
+
+    // The frame a buffered frame is coded against: its reference, else the
+    // frame before it, which for the first is `prev`
+    static ASCIIFrameView baseFrame(const ASCIIVideo& segment, ASCIIFrameView prev, const std::vector<FramePlan>& plans,
+                                    std::size_t i) {
+        return plans[i].base ? ASCIIFrameView(*plans[i].base) : i > 0 ? segment[i - 1] : prev;
+    }
+
+    // Encodes one segment, table record first, coding each frame as `plans`
+    // says. Frames whose statistics drift from those of the frames before
+    // them open a new table.
+    static void encodeSegment(const ASCIIVideo& segment, ASCIIFrameView prev, const std::vector<FramePlan>& plans,
+                              const EncoderOptions& options, std::string& out) {
+        // The palette only pays off where cells repeat, so a segment it would
+        // grow is coded without it, marked by an empty palette table
+        CellCoding coding = cellCoding(options);
+        double bits;
+        std::vector<ContextCounts> frameCounts = countSegment(segment, prev, plans, coding,
+                                                              options.entropyCoder, bits);
+        if (coding.palette) {
+            coding.palette = false;
+            double literalBits;
+            std::vector<ContextCounts> literalCounts = countSegment(segment, prev, plans, coding,
+                                                                    options.entropyCoder, literalBits);
+            if (literalBits <= bits) {
+                frameCounts = std::move(literalCounts);
+            } else {
+                coding.palette = true;
+            }
+        }
+
+        std::ostringstream buffer;
+        std::size_t begin = 0;
+        ContextCounts counts = frameCounts[0];
+        for (std::size_t i = 1; i <= segment.size(); ++i) {
+            if (i < segment.size() &&
+                (options.tableDrift <= 0 || !statisticsDrifted(counts, frameCounts[i], options.tableDrift))) {
+                for (int context = 0; context < kContextCount; ++context) {
+                    std::ranges::transform(counts[context], frameCounts[i][context], counts[context].begin(), std::plus{});
+                }
+                continue;
+            }
+            compressRun(buffer, segment, begin, i, prev, plans, options, coding, counts);
+            if (i < segment.size()) {
+                begin = i;
+                counts = frameCounts[i];
+            }
+        }
+        out = std::move(buffer).str();
+    }
+
+    // A dry run over the segment gives the statistics of exactly the cells each
+    // frame codes, and the estimated size of the segment's payload
+    static std::vector<ContextCounts> countSegment(const ASCIIVideo& segment, ASCIIFrameView prev,
+                                                   const std::vector<FramePlan>& plans,
+                                                   const CellCoding& coding, EntropyCoder coder, double& bits) {
+        std::vector<ContextCounts> frameCounts(segment.size());
+        ContextCounts total{};
+        std::size_t rawBits = 0;
+        for (std::size_t i = 0; i < segment.size(); ++i) {
+            SymbolCounter counter;
+            writeFrameCells(counter, segment[i], !plans[i].key, baseFrame(segment, prev, plans, i), coding, plans[i].pan);
+            frameCounts[i] = counter.result();
+            rawBits += counter.raw().bitCount();
+            for (int context = 0; context < kContextCount; ++context) {
+                std::ranges::transform(total[context], frameCounts[i][context], total[context].begin(), std::plus{});
+            }
+        }
+        bits = static_cast<double>(rawBits);
+        for (const SymbolCounts& counts : total) {
+            bits += estimateTableBits(counts, coder);
+        }
+        return frameCounts;
+    }
+
+    // Writes a table record for frames begin..end of the segment, then the
+    // frames. The table lists every context the file uses; ones `coding`
+    // leaves out are written empty.
+    static void compressRun(std::ostream& out, const ASCIIVideo& segment, std::size_t begin, std::size_t end,
+                            ASCIIFrameView prev, const std::vector<FramePlan>& plans, const EncoderOptions& options,
+                            const CellCoding& coding, const ContextCounts& counts) {
+        const CellCoding fileCoding = cellCoding(options);
+        writeValue(out, FrameType::Table);
+        if (options.entropyCoder == EntropyCoder::Rans) {
+            std::array<RansTable, kContextCount> tables;
+            for (int context = 0; context < kContextCount; ++context) {
+                if (!fileCoding.usesContext(context)) {
+                    continue;
+                }
+                const RansFrequencies freq = normalizeFrequencies(counts[context]);
+                writeFrequencies(out, freq);
+                tables[context] = RansTable(freq);
+            }
+            RansSymbolWriter symbols(tables);
+            compressFrames(out, segment, begin, end, prev, plans, coding, symbols);
+        } else {
+            std::array<HuffmanCodeTable, kContextCount> codes{};
+            for (int context = 0; context < kContextCount; ++context) {
+                if (!fileCoding.usesContext(context)) {
+                    continue;
+                }
+                const CodeLengths lengths = buildCodeLengths(counts[context]);
+                writeCodeLengths(out, lengths);
+                codes[context] = buildCanonicalCodes(lengths);
+            }
+            HuffmanSymbolWriter symbols(codes);
+            compressFrames(out, segment, begin, end, prev, plans, coding, symbols);
+        }
+    }
+
+    template <typename SymbolWriter>
+    static void compressFrames(std::ostream& out, const ASCIIVideo& segment, std::size_t begin, std::size_t end,
+                               ASCIIFrameView prev, const std::vector<FramePlan>& plans, const CellCoding& coding,
+                               SymbolWriter& symbols) {
+        for (std::size_t i = begin; i < end; ++i) {
+            if (plans[i].reference >= 0) {
+                writeValue(out, FrameType::Reference);
+                writeValue(out, static_cast<std::uint8_t>(plans[i].reference));
+            }
+            compressFrame(out, segment[i], symbols, !plans[i].key, baseFrame(segment, prev, plans, i), coding,
+                          plans[i].pan);
+            if (plans[i].store >= 0) {
+                writeValue(out, FrameType::Keep);
+                writeValue(out, static_cast<std::uint8_t>(plans[i].store));
+            }
+        }
+    }
+
+    void closeSegment() {
+        if (++activeSegment == segments.size()) {
+            flushSegments();
+        }
+    }
+
+    void flushSegments() {
+        // Every segment's reference frame is already buffered, so all of them
+        // encode independently; the calling thread takes the first
+        std::vector<std::thread> workers;
+        ASCIIFrameView prev = prevFrame;
+        for (std::size_t k = 0; k < segments.size() && !segments[k].empty(); ++k) {
+            if (k > 0) {
+                workers.emplace_back(encodeSegment, std::cref(segments[k]), prev, std::cref(segmentPlans[k]),
+                                     std::cref(options), std::ref(encoded[k]));
+            }
+            prev = segments[k][segments[k].size() - 1];
+        }
+        if (segments[0].empty()) {
+            return;
+        }
+        encodeSegment(segments[0], prevFrame, segmentPlans[0], options, encoded[0]);
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+
+        for (std::size_t k = 0; k < segments.size() && !segments[k].empty(); ++k) {
+            // A key that is not a seek point may be followed by frames coded
+            // against slots kept before it, so only seek points are indexed
+            if (segmentPlans[k][0].seekPoint) {
+                seekIndex.push_back({framesWritten, static_cast<std::int64_t>(outFile.tellp())});
+            }
+            outFile.write(encoded[k].data(), static_cast<std::streamsize>(encoded[k].size()));
+            framesWritten += static_cast<int>(segments[k].size());
+        }
+
+        const ASCIIFrameView last = prev;
+        prevFrame = ASCIIFrame(last.width, last.height, std::vector<Cell>(last.cells.begin(), last.cells.end()));
+        for (ASCIIVideo& segment : segments) {
+            segment.clear();
+        }
+        for (std::vector<FramePlan>& plans : segmentPlans) {
+            plans.clear();
+        }
+        framesPending = 0;
+        activeSegment = 0;
+    }
+
+    EncoderOptions options;
+    fs::path outPath;
+    std::ofstream outFile;
+    std::streampos frameCountPos;
+    int framesWritten = 0;
+    int framesPending = 0;
+    int lastSeekPoint = 0;
+    std::vector<SeekEntry> seekIndex;
+    std::vector<ASCIIVideo> segments;
+    std::vector<std::vector<FramePlan>> segmentPlans;
+    std::vector<std::string> encoded;
+    std::size_t activeSegment = 0;
+    ASCIIFrame prevFrame;
+    // Last frame as the decoder will reconstruct it, in lossy mode
+    ASCIIFrame shown;
+    std::array<ReferenceSlot, kReferenceSlots> references;
+    std::array<std::uint64_t, kShotHistory> shotHistory{};
+    std::size_t shotCount = 0;
+};
+
+inline void compressASCIIVideo(const ASCIIVideo& video, const std::string& outPathStr, EncoderOptions options = {}) {
+    ASCIIVideoEncoder encoder(options);
+    if (!encoder.open(outPathStr)) {
+        return;
+    }
+    for (std::size_t i = 0; i < video.size(); ++i) {
+        if (!encoder.pushFrame(video[i])) {
+            break;
+        }
+    }
+    encoder.finish();
 }
 
-#endif // CODEC_H
\ No newline at end of file
+#endif // CODEC_H
@@ -16,7 +16,6 @@
 #include "stb_image_write.h"
 
 using cv::Mat;
-using ASCIIFrame = std::vector<std::pair<char, rgb>>;
 
 namespace fs = std::filesystem;
 
@@ -27,15 +26,16 @@ const auto brightness = [](const Mat& tile) -> uint {
     return static_cast<uint>(cv::mean(tile)[0]);
 };
 
-const auto color = [](const Mat& tile) -> rgb {
+const auto color = [](const Mat& tile, char glyph) -> Cell {
     if (tile.empty()) {
-        return { 0, 0, 0 };
+        return { glyph, 0, 0, 0 };
     }
     const cv::Scalar meanColor = cv::mean(tile);
     return {
-        static_cast<unsigned int>(meanColor[2]),
-        static_cast<unsigned int>(meanColor[1]),
-        static_cast<unsigned int>(meanColor[0])
+        glyph,
+        static_cast<std::uint8_t>(meanColor[2]),
+        static_cast<std::uint8_t>(meanColor[1]),
+        static_cast<std::uint8_t>(meanColor[0])
     };
 };
 
@@ -59,7 +59,6 @@ std::vector<Mat> loadVideo(const std::string& filePath) {
 
 ASCIIFrame convertToASCII(const Mat& media) {
     const std::string gradient = "@%#*+=-:. ";
-    ASCIIFrame asciiOutput;
 
     Mat grayScale;
     cv::cvtColor(media, grayScale, cv::COLOR_BGR2GRAY);
@@ -69,7 +68,11 @@ ASCIIFrame convertToASCII(const Mat& media) {
     const double glyphAspectRatio = 0.5;
     const int tileW = std::max(1, ImgW / targetColumns);
     const int tileH = std::max(1, static_cast<int>(tileW / glyphAspectRatio));
+    const int columns = (ImgW + tileW - 1) / tileW;
+    const int rows = (ImgH + tileH - 1) / tileH;
 
+    ASCIIFrame asciiOutput(columns, rows);
+    Cell* out = asciiOutput.cells.data();
     for (int y = 0; y < ImgH; y += tileH) {
         for (int x = 0; x < ImgW; x += tileW) {
             const int w = std::min(tileW, ImgW - x);
@@ -82,27 +85,52 @@ ASCIIFrame convertToASCII(const Mat& media) {
                 static_cast<double>(value) / 255.0 * (gradient.size() - 1),
                 0.0,
                 static_cast<double>(gradient.size() - 1)));
-            asciiOutput.emplace_back(gradient[gradientIndex], color(colorTile));
+            *out++ = color(colorTile, gradient[gradientIndex]);
         }
-        asciiOutput.emplace_back('\n', rgb{ 0, 0, 0 });
     }
-    asciiOutput.emplace_back('\n', rgb{ 0, 0, 0 });
 
     return asciiOutput;
 }
 
-std::unordered_map<int, ASCIIFrame> convertVideoToASCII(const std::vector<Mat>& media) {
-    std::unordered_map<int, ASCIIFrame> asciiVideo;
-    int count = 0;
+ASCIIVideo convertVideoToASCII(const std::vector<Mat>& media) {
+    ASCIIVideo asciiVideo;
     for (const auto& frame : media) {
-        asciiVideo[count++] = convertToASCII(frame);
+        const ASCIIFrame asciiFrame = convertToASCII(frame);
+        if (asciiVideo.empty()) {
+            asciiVideo = ASCIIVideo(asciiFrame.width, asciiFrame.height);
+            asciiVideo.reserve(media.size());
+        }
+        asciiVideo.push_back(asciiFrame);
     }
     return asciiVideo;
 }
 
-SDL_Surface* renderASCIISurface(const std::vector<std::pair<char, rgb>>& media,
-    const std::string& fontPath,
-    const int pointSize)
+// Converts and encodes a video one frame at a time, so neither the decoded
+// frames nor the ASCII video are ever held in memory as a whole.
+int compressVideoToASCII(const std::string& filePath, const std::string& outPath) {
+    cv::VideoCapture videoCapture(filePath);
+    if (!videoCapture.isOpened()) {
+        return 0;
+    }
+    EncoderOptions options;
+    options.fps = static_cast<float>(videoCapture.get(cv::CAP_PROP_FPS));
+    ASCIIVideoEncoder encoder(options);
+    if (!encoder.open(outPath)) {
+        return 0;
+    }
+    Mat frame;
+    while (videoCapture.read(frame)) {
+        if (!encoder.pushFrame(convertToASCII(frame))) {
+            break;
+        }
+    }
+    videoCapture.release();
+    const int frameCount = encoder.frameCount();
+    return encoder.finish() ? frameCount : 0;
+}
+
+// Opens the font and measures the glyph box every cell is drawn into
+static TTF_Font* openASCIIFont(const std::string& fontPath, int pointSize, int& glyphW, int& glyphH)
 {
     TTF_Font* font = TTF_OpenFont(fontPath.c_str(), static_cast<float>(pointSize));
     if (font == nullptr) {
@@ -110,68 +138,89 @@ SDL_Surface* renderASCIISurface(const std::vector<std::pair<char, rgb>>& media,
         return nullptr;
     }
 
-    int glyphW = 0;
-    int glyphH = 0;
     if (!TTF_GetStringSize(font, "@", 0, &glyphW, &glyphH)) {
         std::cerr << "TTF_GetStringSize failed: " << SDL_GetError() << '\n';
         TTF_CloseFont(font);
         return nullptr;
     }
-    
-    int maxColumns = 0;
-    int columns = 0;
-    int rows = 1;
-    for (const auto& [glyph, _] : media) {
-        if (glyph == '\n') {
-            maxColumns = std::max(columns, maxColumns);
-            columns = 0;
-            ++rows;
-            continue;
+    return font;
+}
+
+static void drawASCIICell(SDL_Surface* surface, TTF_Font* font, int glyphW, int glyphH,
+    const Cell& cell, int column, int row)
+{
+    const SDL_Color sdlColor{ cell.r, cell.g, cell.b, 255 };
+
+    const char text[2]{ cell.glyph, '\0' };
+    SDL_Surface* glyphSurface = TTF_RenderText_Blended(font, text, 0, sdlColor);
+    if (glyphSurface == nullptr) {
+        std::cerr << "TTF_RenderText_Blended failed: " << SDL_GetError() << '\n';
+        return;
+    }
+
+    SDL_Rect dst{ column * glyphW, row * glyphH, glyphSurface->w, glyphSurface->h };
+    SDL_BlitSurface(glyphSurface, nullptr, surface, &dst);
+    SDL_DestroySurface(glyphSurface);
+}
+
+static void drawASCIIFrame(SDL_Surface* surface, TTF_Font* font, int glyphW, int glyphH, ASCIIFrameView media)
+{
+    const SDL_PixelFormatDetails* formatDetails = SDL_GetPixelFormatDetails(surface->format);
+    SDL_FillSurfaceRect(surface, nullptr, SDL_MapRGBA(formatDetails, NULL, 0, 0, 0, 255));
+
+    for (int row = 0; row < media.height; ++row) {
+        for (int column = 0; column < media.width; ++column) {
+            drawASCIICell(surface, font, glyphW, glyphH, media.at(column, row), column, row);
         }
-        ++columns;
     }
-    maxColumns = std::max(columns, maxColumns);
+}
+
+SDL_Surface* renderASCIISurface(ASCIIFrameView media,
+    const std::string& fontPath,
+    const int pointSize)
+{
+    int glyphW = 0;
+    int glyphH = 0;
+    TTF_Font* font = openASCIIFont(fontPath, pointSize, glyphW, glyphH);
+    if (font == nullptr) {
+        return nullptr;
+    }
 
-    SDL_Surface* surface = SDL_CreateSurface(maxColumns * glyphW, rows * glyphH, SDL_PIXELFORMAT_RGBA32);
+    SDL_Surface* surface = SDL_CreateSurface(media.width * glyphW, media.height * glyphH, SDL_PIXELFORMAT_RGBA32);
     if (surface == nullptr) {
         std::cerr << "SDL_CreateSurface failed: " << SDL_GetError() << '\n';
         TTF_CloseFont(font);
         return nullptr;
     }
-    const SDL_PixelFormatDetails* formatDetails = SDL_GetPixelFormatDetails(surface->format);
-    SDL_FillSurfaceRect(surface, nullptr, SDL_MapRGBA(formatDetails, NULL, 0, 0, 0, 255));
+    drawASCIIFrame(surface, font, glyphW, glyphH, media);
 
-    int x = 0;
-    int y = 0;
-    for (const auto& [glyph, color] : media) {
-        if (glyph == '\n') {
-            x = 0;
-            y += glyphH;
-            continue;
-        }
+    TTF_CloseFont(font);
+    return surface;
+}
 
-        const SDL_Color sdlColor{
-            static_cast<Uint8>(color[0]),
-            static_cast<Uint8>(color[1]),
-            static_cast<Uint8>(color[2]),
-            255
-        };
-
-        const char text[2]{ glyph, '\0' };
-        SDL_Surface* glyphSurface = TTF_RenderText_Blended(font, text, 0, sdlColor);
-        if (glyphSurface == nullptr) {
-            std::cerr << "TTF_RenderText_Blended failed: " << SDL_GetError() << '\n';
-            continue;
+static bool WriteGifFrame(GifWriter& writer, SDL_Surface* surf, std::vector<uint8_t>& rgba, int delayCs)
+{
+    SDL_Surface* converted = surf;
+    if (surf->format != SDL_PIXELFORMAT_RGBA32) {
+        converted = SDL_ConvertSurface(surf, SDL_PIXELFORMAT_RGBA32);
+        if (!converted) {
+            std::cerr << "Surface conversion failed\n";
+            return false;
         }
+    }
 
-        SDL_Rect dst{ x, y, glyphSurface->w, glyphSurface->h };
-        SDL_BlitSurface(glyphSurface, nullptr, surface, &dst);
-        SDL_DestroySurface(glyphSurface);
-        x += glyphW;
+    rgba.resize(static_cast<size_t>(surf->w) * static_cast<size_t>(surf->h) * 4);
+    std::memcpy(rgba.data(), converted->pixels, rgba.size());
+
+    if (converted != surf) {
+        SDL_DestroySurface(converted);
     }
 
-    TTF_CloseFont(font);
-    return surface;
+    if (!GifWriteFrame(&writer, rgba.data(), surf->w, surf->h, delayCs)) {
+        std::cerr << "GifWriteFrame failed\n";
+        return false;
+    }
+    return true;
 }
 
 static bool SaveGif(const std::vector<SDL_Surface*>& frames, const std::string& path, int delayMs)
@@ -199,25 +248,7 @@ static bool SaveGif(const std::vector<SDL_Surface*>& frames, const std::string&
             GifEnd(&writer);
             return false;
         }
-
-        SDL_Surface* converted = surf;
-        if (surf->format != SDL_PIXELFORMAT_RGBA32) {
-            converted = SDL_ConvertSurface(surf, SDL_PIXELFORMAT_RGBA32);
-            if (!converted) {
-                std::cerr << "Surface conversion failed\n";
-                GifEnd(&writer);
-                return false;
-            }
-        }
-
-        std::memcpy(rgba.data(), converted->pixels, rgba.size());
-
-        if (converted != surf) {
-            SDL_DestroySurface(converted);
-        }
-
-        if (!GifWriteFrame(&writer, rgba.data(), w, h, delayCs)) {
-            std::cerr << "GifWriteFrame failed\n";
+        if (!WriteGifFrame(writer, surf, rgba, delayCs)) {
             GifEnd(&writer);
             return false;
         }
@@ -285,6 +316,41 @@ static bool SaveJPG(SDL_Surface* surface, const std::string& path, int quality =
     return result != 0;
 }
 
+static bool WriteMP4Frame(cv::VideoWriter& writer, SDL_Surface* surf)
+{
+    SDL_Surface* converted = surf;
+    if (surf->format != SDL_PIXELFORMAT_RGB24) {
+        converted = SDL_ConvertSurface(surf, SDL_PIXELFORMAT_RGB24);
+        if (!converted) {
+            std::cerr << "Surface conversion failed\n";
+            return false;
+        }
+    }
+
+    // OpenCV uses BGR, convert RGB to BGR
+    const int w = surf->w;
+    const int h = surf->h;
+    Mat frame(h, w, CV_8UC3);
+    const uint8_t* pixels = static_cast<const uint8_t*>(converted->pixels);
+
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            int srcIdx = (y * converted->pitch) + (x * 3);
+            int dstIdx = (y * w + x) * 3;
+            frame.data[dstIdx + 0] = pixels[srcIdx + 2]; // B
+            frame.data[dstIdx + 1] = pixels[srcIdx + 1]; // G
+            frame.data[dstIdx + 2] = pixels[srcIdx + 0]; // R
+        }
+    }
+
+    writer.write(frame);
+
+    if (converted != surf) {
+        SDL_DestroySurface(converted);
+    }
+    return true;
+}
+
 static bool SaveMP4(const std::vector<SDL_Surface*>& frames, const std::string& path, int fps)
 {
     if (frames.empty()) {
@@ -311,35 +377,9 @@ static bool SaveMP4(const std::vector<SDL_Surface*>& frames, const std::string&
             writer.release();
             return false;
         }
-
-        SDL_Surface* converted = surf;
-        if (surf->format != SDL_PIXELFORMAT_RGB24) {
-            converted = SDL_ConvertSurface(surf, SDL_PIXELFORMAT_RGB24);
-            if (!converted) {
-                std::cerr << "Surface conversion failed\n";
-                writer.release();
-                return false;
-            }
-        }
-
-        // OpenCV uses BGR, convert RGB to BGR
-        Mat frame(h, w, CV_8UC3);
-        const uint8_t* pixels = static_cast<const uint8_t*>(converted->pixels);
-
-        for (int y = 0; y < h; ++y) {
-            for (int x = 0; x < w; ++x) {
-                int srcIdx = (y * converted->pitch) + (x * 3);
-                int dstIdx = (y * w + x) * 3;
-                frame.data[dstIdx + 0] = pixels[srcIdx + 2]; // B
-                frame.data[dstIdx + 1] = pixels[srcIdx + 1]; // G
-                frame.data[dstIdx + 2] = pixels[srcIdx + 0]; // R
-            }
-        }
-
-        writer.write(frame);
-
-        if (converted != surf) {
-            SDL_DestroySurface(converted);
+        if (!WriteMP4Frame(writer, surf)) {
+            writer.release();
+            return false;
         }
     }
 
@@ -374,11 +414,7 @@ static std::vector<SDL_Surface*> renderASCIIVideoSurfaces(const ASCIIVideo& asci
     surfaceFrames.reserve(asciiVideo.size());
 
     for (int i = 0; i < static_cast<int>(asciiVideo.size()); ++i) {
-        if (asciiVideo.find(i) == asciiVideo.end()) {
-            std::cerr << "Frame " << i << " not found in video\n";
-            continue;
-        }
-        SDL_Surface* surface = renderASCIISurface(asciiVideo.at(i), fontPath, pointSize);
+        SDL_Surface* surface = renderASCIISurface(asciiVideo[i], fontPath, pointSize);
         if (surface) {
             surfaceFrames.emplace_back(surface);
             if ((i + 1) % 10 == 0) {
@@ -548,6 +584,106 @@ void saveASCIIVideo(const ASCIIVideo& asciiVideo,
     }
 }
 
+// Renders and encodes a compressed .bin one frame at a time. Only one ASCII
+// frame and one surface are alive at once, and delta frames redraw just the
+// cells they changed. A delayMs of 0 takes the frame rate from the file.
+void saveASCIIVideo(const std::string& binPath,
+    const std::string& fontPath,
+    int pointSize,
+    const std::string& outputPath,
+    int delayMs)
+{
+    fs::path outPath(outputPath);
+    const std::string ext = outPath.has_extension() ? outPath.extension().string() : ".mp4";
+
+    if (!ensureOutputDir(outPath, ext)) {
+        return;
+    }
+
+    int glyphW = 0;
+    int glyphH = 0;
+    TTF_Font* font = openASCIIFont(fontPath, pointSize, glyphW, glyphH);
+    if (font == nullptr) {
+        return;
+    }
+
+    const bool gif = outPath.extension() == ".gif";
+    int delayCs = 0;
+    SDL_Surface* surface = nullptr;
+    cv::VideoWriter mp4Writer;
+    GifWriter gifWriter{};
+    bool gifOpen = false;
+    std::vector<uint8_t> rgba;
+    int framesWritten = 0;
+
+    try {
+        ASCIIVideoDecoder decoder;
+        if (!decoder.open(binPath)) {
+            TTF_CloseFont(font);
+            return;
+        }
+        std::cerr << "Processing " << decoder.frameCount() << " frames...\n";
+        if (delayMs <= 0) {
+            delayMs = decoder.framesPerSecond() > 0 ? static_cast<int>(1000 / decoder.framesPerSecond() + 0.5f) : 17;
+        }
+        delayCs = std::max(1, delayMs / 10); // gif delay in 1/100s
+
+        while (decoder.next()) {
+            const ASCIIFrameView frame = decoder.frame();
+            if (surface == nullptr) {
+                surface = SDL_CreateSurface(frame.width * glyphW, frame.height * glyphH, SDL_PIXELFORMAT_RGBA32);
+                if (surface == nullptr) {
+                    std::cerr << "SDL_CreateSurface failed: " << SDL_GetError() << '\n';
+                    break;
+                }
+                if (gif) {
+                    gifOpen = GifBegin(&gifWriter, outPath.string().c_str(), surface->w, surface->h, delayCs);
+                } else {
+                    mp4Writer.open(outPath.string(), cv::VideoWriter::fourcc('m', 'p', '4', 'v'),
+                                   1000 / delayMs, cv::Size(surface->w, surface->h));
+                }
+                if (gif ? !gifOpen : !mp4Writer.isOpened()) {
+                    std::cerr << "Failed to open video writer for " << outPath.string() << '\n';
+                    break;
+                }
+            }
+
+            if (decoder.keyFrame()) {
+                drawASCIIFrame(surface, font, glyphW, glyphH, frame);
+            } else {
+                const SDL_PixelFormatDetails* formatDetails = SDL_GetPixelFormatDetails(surface->format);
+                const Uint32 black = SDL_MapRGBA(formatDetails, NULL, 0, 0, 0, 255);
+                for (const std::uint32_t index : decoder.changedCells()) {
+                    const int column = static_cast<int>(index) % frame.width;
+                    const int row = static_cast<int>(index) / frame.width;
+                    const SDL_Rect box{ column * glyphW, row * glyphH, glyphW, glyphH };
+                    SDL_FillSurfaceRect(surface, &box, black);
+                    drawASCIICell(surface, font, glyphW, glyphH, frame[index], column, row);
+                }
+            }
+
+            if (gif ? !WriteGifFrame(gifWriter, surface, rgba, delayCs) : !WriteMP4Frame(mp4Writer, surface)) {
+                break;
+            }
+            if (++framesWritten % 10 == 0) {
+                std::cerr << "Processed " << framesWritten << " frames\n";
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Exception during decompression: " << e.what() << '\n';
+    }
+
+    if (gifOpen) {
+        GifEnd(&gifWriter);
+    }
+    mp4Writer.release();
+    if (surface) {
+        SDL_DestroySurface(surface);
+    }
+    TTF_CloseFont(font);
+    std::cerr << "Saved " << framesWritten << " frames to " << outPath.string() << '\n';
+}
+
 int main(int argc, char* argv[]) {
     if (!SDL_Init(SDL_INIT_VIDEO)) {
         std::cerr << "SDL could not initialize! SDL_Error: " << SDL_GetError() << std::endl;
@@ -576,28 +712,16 @@ int main(int argc, char* argv[]) {
         std::cerr << "No image found at " << imageAssetPath << ", skipping image conversion\n";
     }
 
-    // Convert and save video
-    const std::vector<Mat> video = loadVideo(videoAssetPath);
-    if (video.empty()) {
-        std::cerr << "Failed to load video from " << videoAssetPath << '\n';
-        return 1;
-    }
-
     // Testing Compression and Decompression
     std::cerr << "Compressing video...\n";
-    compressASCIIVideo(convertVideoToASCII(video), "ascii_video.bin");
-
-    std::cerr << "Loading compressed video from ascii_video.bin...\n";
-    auto asciiVid = decompressASCIIVideo("ascii_video.bin");
-    
-    if (asciiVid.empty()) {
-        std::cerr << "Failed to decompress video!\n";
+    if (compressVideoToASCII(videoAssetPath, "ascii_video.bin") == 0) {
+        std::cerr << "Failed to load video from " << videoAssetPath << '\n';
         return 1;
     }
-    std::cerr << "Successfully decompressed " << asciiVid.size() << " frames\n";
 
-    // Convert and save video
-    saveASCIIVideo(asciiVid, fontPath, 10, outputPath + "_video.mp4", 17);
+    // Decode, render and save the video straight from the compressed file
+    std::cerr << "Rendering compressed video from ascii_video.bin...\n";
+    saveASCIIVideo("ascii_video.bin", fontPath, 10, outputPath + "_video.mp4", 0);
 
     TTF_Quit();
     SDL_Quit();
@@ -4,31 +4,46 @@
 int main() {
     // Testing bit packing/unpacking functions directly
     std::println("Testing bit manipulation functions...\n");
-    
-    // Test 1: stringToByte and byteToString
-    std::string testBits = "10110010";
-    unsigned char byte = stringToByte(testBits, 0);
-    std::println("Input:  '{}'", testBits);
-    std::println("Byte:   0x{:02X} ({})", byte, (int)byte);
-    std::string recovered = byteToString(byte);
-    std::println("Output: '{}'", recovered);
-    std::println("Match: {}\n", testBits == recovered ? "YES" : "NO");
-    
-    // Test 2: Write and read bit string
+
+    // Test 1: BitWriter and BitReader on a single byte
+    BitWriter byteWriter;
+    byteWriter.writeBits(0b10110010, 8);
+    const std::vector<std::uint8_t>& byteData = byteWriter.finish();
+    std::println("Input:  0b10110010");
+    std::println("Byte:   0x{:02X} ({})", byteData[0], (int)byteData[0]);
+    BitReader byteReader(byteData, 8);
+    const auto recovered = byteReader.readBits(8);
+    std::println("Output: 0x{:02X}", recovered);
+    std::println("Match: {}\n", recovered == 0b10110010 ? "YES" : "NO");
+
+    // Test 2: Write and read a bit stream of mixed field widths
+    const std::vector<std::pair<std::uint64_t, int>> fields = {
+        {0b101, 3}, {0xABCD, 16}, {0, 1}, {0x1FFFFFFFF, 33}, {0x2A, 7}, {0xDEADBEEF, 32}, {1, 1}
+    };
+    BitWriter writer;
+    for (const auto& [value, width] : fields) {
+        writer.writeBits(value, width);
+    }
     std::ofstream out("test_bits.bin", std::ios::binary);
-    std::string originalBits = "101011001110101010110011101010101100111010";
-    std::println("Original bits ({} bits): '{}'", originalBits.length(), originalBits);
-    writeBitString(out, originalBits);
+    std::println("Original stream: {} fields, {} bits", fields.size(), writer.bitCount());
+    writeBitStream(out, writer);
     out.close();
-    
+
     std::ifstream in("test_bits.bin", std::ios::binary);
     int bitCount;
     in.read(reinterpret_cast<char*>(&bitCount), sizeof(int));
     std::println("Read bitCount: {}", bitCount);
-    
-    std::string recoveredBits = readBitsAsString(in, bitCount);
-    std::println("Recovered bits ({} bits): '{}'", recoveredBits.length(), recoveredBits);
-    std::println("Match: {}", originalBits == recoveredBits ? "YES" : "NO");
-    
+
+    std::vector<std::uint8_t> bytes;
+    readBitStream(in, bitCount, bytes);
+    BitReader reader(bytes, bitCount);
+    bool match = true;
+    for (const auto& [value, width] : fields) {
+        const auto field = reader.readBits(width);
+        std::println("  {}-bit field: 0x{:X}", width, field);
+        match = match && field == value;
+    }
+    std::println("Match: {}", match && !reader.overrun() && reader.position() == static_cast<std::size_t>(bitCount) ? "YES" : "NO");
+
     return 0;
 }
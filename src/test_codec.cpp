@@ -1,24 +1,55 @@
 #include "codec.h"
 #include <iostream>
 #include <cassert>
+#include <cstdlib>
+#include <new>
 #include <print>
 
-bool compareFrames(const std::vector<std::pair<char, rgb>>& frame1, 
-                   const std::vector<std::pair<char, rgb>>& frame2) {
-    if (frame1.size() != frame2.size()) {
-        std::println("Frame size mismatch: {} vs {}", frame1.size(), frame2.size());
+// Every allocation the tests make is counted and the largest is kept, so a
+// decode loop can be checked to allocate nothing and a corrupt file to ask
+// for no huge buffer
+static std::atomic<std::size_t> allocationCount{0};
+static std::atomic<std::size_t> largestAllocation{0};
+
+void* operator new(std::size_t size) {
+    ++allocationCount;
+    std::size_t largest = largestAllocation;
+    while (size > largest && !largestAllocation.compare_exchange_weak(largest, size)) {
+    }
+    if (void* p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+// GCC cannot tell these replace the global pair and warns that malloc'd
+// memory meets a delete expression
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+bool compareFrames(ASCIIFrameView frame1, 
+                   ASCIIFrameView frame2) {
+    if (frame1.width != frame2.width || frame1.height != frame2.height) {
+        std::println("Frame size mismatch: {}x{} vs {}x{}", frame1.width, frame1.height, frame2.width, frame2.height);
         return false;
     }
     
     for (size_t i = 0; i < frame1.size(); ++i) {
-        if (frame1[i].first != frame2[i].first) {
-            std::println("Char mismatch at pixel {}: '{}' vs '{}'", i, frame1[i].first, frame2[i].first);
+        if (frame1[i].glyph != frame2[i].glyph) {
+            std::println("Char mismatch at pixel {}: '{}' vs '{}'", i, frame1[i].glyph, frame2[i].glyph);
             return false;
         }
-        if (frame1[i].second != frame2[i].second) {
+        if (frame1[i] != frame2[i]) {
             std::println("RGB mismatch at pixel {}: [{},{},{}] vs [{},{},{}]", 
-                        i, frame1[i].second[0], frame1[i].second[1], frame1[i].second[2],
-                        frame2[i].second[0], frame2[i].second[1], frame2[i].second[2]);
+                        i, frame1[i].r, frame1[i].g, frame1[i].b,
+                        frame2[i].r, frame2[i].g, frame2[i].b);
             return false;
         }
     }
@@ -32,14 +63,9 @@ bool compareVideos(const ASCIIVideo& video1, const ASCIIVideo& video2) {
         return false;
     }
     
-    for (const auto& [frameNum, frame] : video1) {
-        if (video2.find(frameNum) == video2.end()) {
-            std::println("Frame {} missing in decompressed video", frameNum);
-            return false;
-        }
-        
+    for (size_t frameNum = 0; frameNum < video1.size(); ++frameNum) {
         std::println("Comparing frame {}...", frameNum);
-        if (!compareFrames(frame, video2.at(frameNum))) {
+        if (!compareFrames(video1[frameNum], video2[frameNum])) {
             std::println("Frame {} mismatch!", frameNum);
             return false;
         }
@@ -55,25 +81,25 @@ void testSimpleVideo() {
     ASCIIVideo video;
     
     // Frame 0: AAA (all red)
-    video[0] = {
-        {'A', {255, 0, 0}},
-        {'A', {255, 0, 0}},
-        {'A', {255, 0, 0}}
-    };
+    video.push_back(ASCIIFrame(3, 1, {
+        {'A', 255, 0, 0},
+        {'A', 255, 0, 0},
+        {'A', 255, 0, 0}
+    }));
     
     // Frame 1: ABA (middle changed to green B)
-    video[1] = {
-        {'A', {255, 0, 0}},
-        {'B', {0, 255, 0}},
-        {'A', {255, 0, 0}}
-    };
+    video.push_back(ASCIIFrame(3, 1, {
+        {'A', 255, 0, 0},
+        {'B', 0, 255, 0},
+        {'A', 255, 0, 0}
+    }));
     
     // Frame 2: ABC (last changed to blue C)
-    video[2] = {
-        {'A', {255, 0, 0}},
-        {'B', {0, 255, 0}},
-        {'C', {0, 0, 255}}
-    };
+    video.push_back(ASCIIFrame(3, 1, {
+        {'A', 255, 0, 0},
+        {'B', 0, 255, 0},
+        {'C', 0, 0, 255}
+    }));
     
     // Compress
     std::println("Compressing simple video...");
@@ -99,11 +125,11 @@ void testNoChanges() {
     
     // All frames identical
     for (int i = 0; i < 5; ++i) {
-        video[i] = {
-            {'X', {128, 128, 128}},
-            {'Y', {64, 64, 64}},
-            {'Z', {192, 192, 192}}
-        };
+        video.push_back(ASCIIFrame(3, 1, {
+            {'X', 128, 128, 128},
+            {'Y', 64, 64, 64},
+            {'Z', 192, 192, 192}
+        }));
     }
     
     // Compress
@@ -129,24 +155,24 @@ void testLargeFrame() {
     ASCIIVideo video;
     
     // Frame 0: 100 pixels with various characters
-    std::vector<std::pair<char, rgb>> frame0;
+    ASCIIFrame frame0(10, 10);
     for (int i = 0; i < 100; ++i) {
         char ch = 'A' + (i % 26);  // Cycle through A-Z
-        rgb color = {
-            static_cast<unsigned int>((i * 2) % 256),
-            static_cast<unsigned int>((i * 3) % 256),
-            static_cast<unsigned int>((i * 5) % 256)
+        frame0[i] = {
+            ch,
+            static_cast<std::uint8_t>((i * 2) % 256),
+            static_cast<std::uint8_t>((i * 3) % 256),
+            static_cast<std::uint8_t>((i * 5) % 256)
         };
-        frame0.push_back({ch, color});
     }
-    video[0] = frame0;
+    video.push_back(frame0);
     
     // Frame 1: Change every 10th pixel
-    std::vector<std::pair<char, rgb>> frame1 = frame0;
+    ASCIIFrame frame1 = frame0;
     for (int i = 0; i < 100; i += 10) {
-        frame1[i] = {'*', {255, 255, 255}};
+        frame1[i] = {'*', 255, 255, 255};
     }
-    video[1] = frame1;
+    video.push_back(frame1);
     
     // Compress
     std::println("Compressing large frame video...");
@@ -170,13 +196,13 @@ void testSingleFrame() {
     
     ASCIIVideo video;
     
-    video[0] = {
-        {'H', {255, 0, 0}},
-        {'E', {0, 255, 0}},
-        {'L', {0, 0, 255}},
-        {'L', {255, 255, 0}},
-        {'O', {255, 0, 255}}
-    };
+    video.push_back(ASCIIFrame(5, 1, {
+        {'H', 255, 0, 0},
+        {'E', 0, 255, 0},
+        {'L', 0, 0, 255},
+        {'L', 255, 255, 0},
+        {'O', 255, 0, 255}
+    }));
     
     // Compress
     std::println("Compressing single frame video...");
@@ -201,18 +227,18 @@ void testCompleteChange() {
     ASCIIVideo video;
     
     // Frame 0
-    video[0] = {
-        {'A', {255, 0, 0}},
-        {'A', {255, 0, 0}},
-        {'A', {255, 0, 0}}
-    };
+    video.push_back(ASCIIFrame(3, 1, {
+        {'A', 255, 0, 0},
+        {'A', 255, 0, 0},
+        {'A', 255, 0, 0}
+    }));
     
     // Frame 1: Everything changes
-    video[1] = {
-        {'B', {0, 255, 0}},
-        {'B', {0, 255, 0}},
-        {'B', {0, 255, 0}}
-    };
+    video.push_back(ASCIIFrame(3, 1, {
+        {'B', 0, 255, 0},
+        {'B', 0, 255, 0},
+        {'B', 0, 255, 0}
+    }));
     
     // Compress
     std::println("Compressing complete change video...");
@@ -230,6 +256,1241 @@ void testCompleteChange() {
     }
 }
 
+// Test Case 6: Skewed glyph frequencies (codes longer than the decode lookup table)
+void testSkewedAlphabet() {
+    std::println("\n=== Test 6: Skewed Alphabet ===");
+    
+    ASCIIVideo video;
+    
+    // Fibonacci frequencies give a maximally deep Huffman tree (up to 15-bit codes)
+    std::vector<Cell> cells0;
+    int a = 1, b = 1;
+    for (int s = 0; s < 16; ++s) {
+        for (int n = 0; n < a; ++n) {
+            cells0.push_back({static_cast<char>('a' + s), static_cast<std::uint8_t>(s * 16), 0, static_cast<std::uint8_t>(n % 256)});
+        }
+        const int next = a + b;
+        a = b;
+        b = next;
+    }
+    const ASCIIFrame frame0(static_cast<int>(cells0.size()), 1, cells0);
+    video.push_back(frame0);
+    
+    // Frame 1: swap the rarest and most common glyphs at a few positions
+    ASCIIFrame frame1 = frame0;
+    for (size_t i = 0; i < frame1.size(); i += 97) {
+        frame1[i].glyph = frame1[i].glyph == 'a' ? 'p' : 'a';
+    }
+    video.push_back(frame1);
+    
+    // Compress
+    std::println("Compressing skewed alphabet video...");
+    compressASCIIVideo(video, "test_skewed.bin");
+    
+    // Decompress
+    std::println("Decompressing skewed alphabet video...");
+    ASCIIVideo decompressed = decompressASCIIVideo("test_skewed.bin");
+    
+    // Verify
+    if (compareVideos(video, decompressed)) {
+        std::println("Test 6 PASSED: Long Huffman codes decoded correctly!");
+    } else {
+        std::println("Test 6 FAILED: Decompressed video doesn't match original!");
+    }
+}
+
+// Test Case 7: Code lengths beyond the v2 limit
+void testLengthLimitedCodes() {
+    std::println("\n=== Test 7: Length-Limited Codes ===");
+    
+    // 22 Fibonacci-weighted glyphs would need 21-bit codes without the limit
+    std::unordered_map<char, int> charFreq;
+    std::vector<Cell> cells0;
+    int a = 1, b = 1;
+    for (int s = 0; s < 22; ++s) {
+        charFreq[static_cast<char>('A' + s)] = a;
+        for (int n = 0; n < a; ++n) {
+            cells0.push_back({static_cast<char>('A' + s), static_cast<std::uint8_t>(n % 256), 64, 128});
+        }
+        const int next = a + b;
+        a = b;
+        b = next;
+    }
+    
+    const CodeLengths lengths = buildCodeLengths(charFreq);
+    const int longest = *std::max_element(lengths.begin(), lengths.end());
+    std::uint64_t kraft = 0;
+    for (std::uint8_t length : lengths) {
+        if (length > 0) {
+            kraft += std::uint64_t{1} << (kMaxCodeLength - length);
+        }
+    }
+    std::println("Longest code: {} bits, Kraft sum: {}/{}", longest, kraft, std::uint64_t{1} << kMaxCodeLength);
+    
+    ASCIIVideo video;
+    video.push_back(ASCIIFrame(static_cast<int>(cells0.size()), 1, cells0));
+    compressASCIIVideo(video, "test_length_limited.bin");
+    ASCIIVideo decompressed = decompressASCIIVideo("test_length_limited.bin");
+    
+    // Verify
+    if (longest <= kMaxCodeLength && kraft == (std::uint64_t{1} << kMaxCodeLength) && compareVideos(video, decompressed)) {
+        std::println("Test 7 PASSED: Limited code lengths form a complete prefix code and round trip!");
+    } else {
+        std::println("Test 7 FAILED: Length-limited codes are invalid or the round trip failed!");
+    }
+}
+
+// Writes a file in the original v1 layout: bare frame count, pre-order tree,
+// length-prefixed codes and a remainder byte after every payload.
+static void writeLegacyTree(std::ofstream& out, Node* root) {
+    const bool isLeaf = !root->l && !root->r;
+    out.write(reinterpret_cast<const char*>(&isLeaf), sizeof(bool));
+    if (isLeaf) {
+        out.write(&root->character, sizeof(char));
+    } else {
+        writeLegacyTree(out, root->l);
+        writeLegacyTree(out, root->r);
+    }
+}
+
+static void writeLegacyVideo(const std::vector<std::vector<Cell>>& video, const std::string& path) {
+    std::unordered_map<char, int> charFreq;
+    for (const auto& frame : video) {
+        for (const Cell& cell : frame) {
+            charFreq[cell.glyph]++;
+        }
+    }
+    Node* huffmanTree = buildHuffmanTree(charFreq);
+    HuffmanCodeTable codes{};
+    generateCodes(huffmanTree, 0, 0, codes);
+
+    std::ofstream out(path, std::ios::binary);
+    const int numFrames = static_cast<int>(video.size());
+    out.write(reinterpret_cast<const char*>(&numFrames), sizeof(int));
+    writeLegacyTree(out, huffmanTree);
+    deleteHuffmanTree(huffmanTree);
+
+    for (int i = 0; i < numFrames; ++i) {
+        const auto& frame = video[i];
+        BitWriter bits;
+        int count = 0;
+        for (size_t p = 0; p < frame.size(); ++p) {
+            if (i > 0 && frame[p] == video[i - 1][p]) {
+                continue;
+            }
+            if (i > 0) {
+                bits.writeBits(p, 32);
+            }
+            const HuffmanCode& code = codes[static_cast<unsigned char>(frame[p].glyph)];
+            bits.writeBits(code.length, 8);
+            bits.writeBits(code.bits, code.length);
+            bits.writeBits(frame[p].r, 8);
+            bits.writeBits(frame[p].g, 8);
+            bits.writeBits(frame[p].b, 8);
+            count++;
+        }
+        const int bitCount = static_cast<int>(bits.bitCount());
+        const unsigned char remainder = bitCount % 8;
+        const std::vector<std::uint8_t>& bytes = bits.finish();
+        out.write(reinterpret_cast<const char*>(&count), sizeof(int));
+        out.write(reinterpret_cast<const char*>(&bitCount), sizeof(int));
+        out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+        out.write(reinterpret_cast<const char*>(&remainder), sizeof(unsigned char));
+    }
+}
+
+// Test Case 8: Reading a v1 file
+void testLegacyFile() {
+    std::println("\n=== Test 8: Legacy v1 File ===");
+    
+    // v1 frames are text: every row is closed by a '\n' cell
+    std::vector<std::vector<Cell>> text(3);
+    text[0] = {
+        {'@', 10, 20, 30},
+        {'#', 40, 50, 60},
+        {'\n', 0, 0, 0},
+        {'.', 70, 80, 90},
+        {'@', 10, 20, 30},
+        {'\n', 0, 0, 0}
+    };
+    text[1] = text[0];
+    text[1][3] = {'#', 1, 2, 3};
+    text[2] = text[1];
+    
+    ASCIIVideo video;
+    video.push_back(ASCIIFrame(2, 2, {text[0][0], text[0][1], text[0][3], text[0][4]}));
+    video.push_back(ASCIIFrame(2, 2, {text[1][0], text[1][1], text[1][3], text[1][4]}));
+    video.push_back(video[1]);
+    
+    writeLegacyVideo(text, "test_legacy_v1.bin");
+    ASCIIVideo decompressed = decompressASCIIVideo("test_legacy_v1.bin");
+    
+    // Verify
+    if (compareVideos(video, decompressed)) {
+        std::println("Test 8 PASSED: v1 file decoded through the legacy path!");
+    } else {
+        std::println("Test 8 FAILED: v1 file did not decode correctly!");
+    }
+}
+
+// Test Case 9: Contiguous frame store
+void testFrameStore() {
+    std::println("\n=== Test 9: Frame Store ===");
+    
+    ASCIIVideo video(2, 2);
+    video.reserve(3);
+    video.push_back(ASCIIFrame(2, 2, {{'a', 1, 2, 3}, {'b', 4, 5, 6}, {'c', 7, 8, 9}, {'d', 10, 11, 12}}));
+    
+    // Frames are laid out back to back in the slab
+    std::span<Cell> copied = video.appendFrame(true);
+    copied[3] = {'z', 0, 0, 0};
+    video.push_back(video[0]);
+    const bool contiguous = video[1].cells.data() == video[0].cells.data() + 4 &&
+                            video[2].cells.data() == video[1].cells.data() + 4;
+    
+    bool rejected = false;
+    try {
+        video.push_back(ASCIIFrame(3, 1, {{'x', 0, 0, 0}, {'y', 0, 0, 0}, {'z', 0, 0, 0}}));
+    } catch (const std::invalid_argument&) {
+        rejected = true;
+    }
+    
+    // Verify
+    if (video.size() == 3 && contiguous && rejected &&
+        video[1][0] == video[0][0] && video[1][3].glyph == 'z' && video[2] == video[0]) {
+        std::println("Test 9 PASSED: Frames are stored contiguously and indexed directly!");
+    } else {
+        std::println("Test 9 FAILED: Frame store layout or contents are wrong!");
+    }
+}
+
+// Test Case 10: Streaming encoder with per-segment tables
+void testStreamingEncoder() {
+    std::println("\n=== Test 10: Streaming Encoder ===");
+    
+    // Each segment uses a different alphabet, so every table record matters
+    ASCIIVideo video(4, 2);
+    for (int f = 0; f < 7; ++f) {
+        ASCIIFrame frame(4, 2);
+        for (size_t i = 0; i < frame.size(); ++i) {
+            const char base = f < 3 ? 'a' : 'M';
+            frame[i] = {static_cast<char>(base + (i + f / 2) % 5), static_cast<std::uint8_t>(f * 30), static_cast<std::uint8_t>(i), 7};
+        }
+        video.push_back(frame);
+    }
+    
+    // Compress one frame at a time, three frames per segment
+    std::println("Streaming video to encoder...");
+    ASCIIVideoEncoder encoder(EncoderOptions{3});
+    bool pushed = encoder.open("test_stream.bin");
+    for (size_t f = 0; f < video.size(); ++f) {
+        pushed = pushed && encoder.pushFrame(video[f]);
+    }
+    const bool rejected = !encoder.pushFrame(ASCIIFrame(2, 2));
+    pushed = encoder.finish() && pushed;
+    
+    // Decompress
+    std::println("Decompressing streamed video...");
+    ASCIIVideo decompressed = decompressASCIIVideo("test_stream.bin");
+    
+    // Verify
+    if (pushed && rejected && compareVideos(video, decompressed)) {
+        std::println("Test 10 PASSED: Streamed segments decoded correctly!");
+    } else {
+        std::println("Test 10 FAILED: Streamed video doesn't match original!");
+    }
+}
+
+// Test Case 11: Pull-style frame decoder
+void testFrameDecoder() {
+    std::println("\n=== Test 11: Frame Decoder ===");
+    
+    ASCIIVideo video;
+    video.push_back(ASCIIFrame(3, 2, {{'a', 1, 1, 1}, {'b', 2, 2, 2}, {'c', 3, 3, 3}, {'d', 4, 4, 4}, {'e', 5, 5, 5}, {'f', 6, 6, 6}}));
+    video.push_back(ASCIIFrame(3, 2, {{'a', 1, 1, 1}, {'x', 2, 2, 2}, {'c', 3, 3, 3}, {'d', 4, 4, 4}, {'e', 5, 5, 5}, {'y', 6, 6, 6}}));
+    video.push_back(video[1]);
+    compressASCIIVideo(video, "test_decoder.bin");
+    
+    // Walk the file one frame at a time
+    ASCIIVideoDecoder decoder;
+    bool match = decoder.open("test_decoder.bin") && decoder.frameCount() == 3;
+    std::vector<std::vector<std::uint32_t>> changes;
+    std::vector<bool> keys;
+    while (decoder.next()) {
+        match = match && decoder.frame() == video[decoder.frameIndex()];
+        changes.emplace_back(decoder.changedCells().begin(), decoder.changedCells().end());
+        keys.push_back(decoder.keyFrame());
+    }
+    
+    // Verify
+    const std::vector<std::vector<std::uint32_t>> expected = {{}, {1, 5}, {}};
+    if (match && changes == expected && keys == std::vector<bool>{true, false, false}) {
+        std::println("Test 11 PASSED: Frames and changed cells streamed correctly!");
+    } else {
+        std::println("Test 11 FAILED: Streamed frames or changed cells are wrong!");
+    }
+}
+
+// Test Case 12: Key frames, seeking and range decoding
+void testSeekIndex() {
+    std::println("\n=== Test 12: Seek Index ===");
+    
+    ASCIIVideo video(4, 1);
+    for (int f = 0; f < 10; ++f) {
+        ASCIIFrame frame(4, 1);
+        for (size_t i = 0; i < frame.size(); ++i) {
+            frame[i] = {static_cast<char>('a' + (f + i) % 3), static_cast<std::uint8_t>(f), 0, 0};
+        }
+        video.push_back(frame);
+    }
+    
+    // Key frames every 4 frames, segments that do not line up with them
+    ASCIIVideoEncoder encoder(EncoderOptions{3, 4});
+    encoder.open("test_seek.bin");
+    for (size_t f = 0; f < video.size(); ++f) {
+        encoder.pushFrame(video[f]);
+    }
+    encoder.finish();
+    
+    // Seek forwards past a key frame, then back to an earlier one
+    ASCIIVideoDecoder decoder;
+    bool match = decoder.open("test_seek.bin");
+    for (int target : {9, 2, 5, 0}) {
+        match = match && decoder.seek(target) && decoder.next() && decoder.frameIndex() == target &&
+                decoder.frame() == video[target];
+    }
+    
+    // Decode a range
+    ASCIIVideo range = decompressASCIIVideo("test_seek.bin", 5, 8);
+    bool rangeMatch = range.size() == 4;
+    for (size_t i = 0; rangeMatch && i < range.size(); ++i) {
+        rangeMatch = range[i] == video[5 + i];
+    }
+    
+    // Verify
+    if (match && rangeMatch && compareVideos(video, decompressASCIIVideo("test_seek.bin"))) {
+        std::println("Test 12 PASSED: Seeking and range decoding returned the right frames!");
+    } else {
+        std::println("Test 12 FAILED: Seeking or range decoding returned wrong frames!");
+    }
+}
+
+// Test Case 13: Parallel encoding is deterministic
+void testParallelEncode() {
+    std::println("\n=== Test 13: Parallel Encode ===");
+    
+    ASCIIVideo video(8, 4);
+    for (int f = 0; f < 23; ++f) {
+        ASCIIFrame frame(8, 4);
+        for (size_t i = 0; i < frame.size(); ++i) {
+            frame[i] = {static_cast<char>('A' + (i * 7 + f / 3) % 11), static_cast<std::uint8_t>(i), static_cast<std::uint8_t>(f), 0};
+        }
+        video.push_back(frame);
+    }
+    
+    // Same video with one thread and with four
+    std::vector<std::string> files;
+    for (int threads : {1, 4}) {
+        const std::string path = "test_parallel_" + std::to_string(threads) + ".bin";
+        ASCIIVideoEncoder encoder(EncoderOptions{4, 8, threads});
+        encoder.open(path);
+        for (size_t f = 0; f < video.size(); ++f) {
+            encoder.pushFrame(video[f]);
+        }
+        encoder.finish();
+        std::ifstream in(path, std::ios::binary);
+        files.emplace_back(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    
+    // Verify
+    if (files[0] == files[1] && compareVideos(video, decompressASCIIVideo("test_parallel_4.bin"))) {
+        std::println("Test 13 PASSED: Parallel encode is byte-identical to serial!");
+    } else {
+        std::println("Test 13 FAILED: Parallel encode differs from serial!");
+    }
+}
+
+// Test Case 14: Parallel decoding into preallocated frames
+void testParallelDecode() {
+    std::println("\n=== Test 14: Parallel Decode ===");
+    
+    ASCIIVideo video(6, 3);
+    for (int f = 0; f < 30; ++f) {
+        ASCIIFrame frame(6, 3);
+        for (size_t i = 0; i < frame.size(); ++i) {
+            frame[i] = {static_cast<char>('0' + (i + f / 2) % 10), static_cast<std::uint8_t>(f * 8), static_cast<std::uint8_t>(i), 1};
+        }
+        video.push_back(frame);
+    }
+    
+    // Key frame groups of 7 frames
+    ASCIIVideoEncoder encoder(EncoderOptions{7, 7, 1});
+    encoder.open("test_parallel_decode.bin");
+    for (size_t f = 0; f < video.size(); ++f) {
+        encoder.pushFrame(video[f]);
+    }
+    encoder.finish();
+    
+    // Whole file and a range that starts and ends mid-group, on four threads
+    ASCIIVideo decoded = decompressASCIIVideo("test_parallel_decode.bin", 0, -1, 4);
+    ASCIIVideo range = decompressASCIIVideo("test_parallel_decode.bin", 9, 24, 4);
+    bool rangeMatch = range.size() == 16;
+    for (size_t i = 0; rangeMatch && i < range.size(); ++i) {
+        rangeMatch = range[i] == video[9 + i];
+    }
+    
+    // Verify
+    if (compareVideos(video, decoded) && rangeMatch) {
+        std::println("Test 14 PASSED: Parallel decode matches the original!");
+    } else {
+        std::println("Test 14 FAILED: Parallel decode doesn't match the original!");
+    }
+}
+
+// Test Case 15: Run-coded delta indices at the frame edges and across long gaps
+void testDeltaRuns() {
+    std::println("\n=== Test 15: Delta Runs ===");
+    
+    ASCIIVideo video;
+    ASCIIFrame frame0(300, 300);
+    video.push_back(frame0);
+    
+    // Changes at the first cell, a short run, a run straddling 65536 and the last cell
+    ASCIIFrame frame1 = frame0;
+    for (size_t i : {0, 1, 2, 1000, 65534, 65535, 65536, 65537, 89999}) {
+        frame1[i] = {'#', static_cast<std::uint8_t>(i), 0, 255};
+    }
+    video.push_back(frame1);
+    
+    // Every other cell changes: one-cell runs with one-cell gaps
+    ASCIIFrame frame2 = frame1;
+    for (size_t i = 0; i < frame2.size(); i += 2) {
+        frame2[i].glyph = '*';
+    }
+    video.push_back(frame2);
+    
+    compressASCIIVideo(video, "test_delta_runs.bin");
+    ASCIIVideo decompressed = decompressASCIIVideo("test_delta_runs.bin");
+    
+    // Verify
+    if (compareVideos(video, decompressed)) {
+        std::println("Test 15 PASSED: Delta runs decoded correctly!");
+    } else {
+        std::println("Test 15 FAILED: Delta runs decoded incorrectly!");
+    }
+}
+
+// Test Case 16: Colour residual coding with wrap-around and noisy colours
+void testColourCoding() {
+    std::println("\n=== Test 16: Colour Coding ===");
+    
+    ASCIIVideo video;
+    
+    // Frame 0: channels jump between 0 and 255, so residuals wrap both ways
+    ASCIIFrame frame0(16, 16);
+    for (size_t i = 0; i < frame0.size(); ++i) {
+        const std::uint8_t v = i % 2 ? 255 : 0;
+        frame0[i] = {'o', v, static_cast<std::uint8_t>(255 - v), static_cast<std::uint8_t>(i)};
+    }
+    video.push_back(frame0);
+    
+    // Frame 1: pseudo-random colours in scattered cells
+    ASCIIFrame frame1 = frame0;
+    std::uint32_t seed = 12345;
+    for (size_t i = 0; i < frame1.size(); i += 3) {
+        seed = seed * 1664525u + 1013904223u;
+        frame1[i] = {'x', static_cast<std::uint8_t>(seed >> 24), static_cast<std::uint8_t>(seed >> 16), static_cast<std::uint8_t>(seed >> 8)};
+    }
+    video.push_back(frame1);
+    
+    compressASCIIVideo(video, "test_colour.bin");
+    ASCIIVideo decompressed = decompressASCIIVideo("test_colour.bin");
+    
+    // Verify
+    if (compareVideos(video, decompressed)) {
+        std::println("Test 16 PASSED: Colour residuals decoded correctly!");
+    } else {
+        std::println("Test 16 FAILED: Colour residuals decoded incorrectly!");
+    }
+}
+
+// Test Case 17: Temporal colour residuals for slowly drifting colours
+void testTemporalColour() {
+    std::println("\n=== Test 17: Temporal Colour ===");
+    
+    // Noisy colours that brighten by one step per frame, with the glyph
+    // flipping in a band of cells so every frame has changes
+    ASCIIVideo video(32, 8);
+    std::uint32_t seed = 99;
+    ASCIIFrame frame(32, 8);
+    for (Cell& cell : frame.cells) {
+        seed = seed * 1664525u + 1013904223u;
+        cell = {'.', static_cast<std::uint8_t>(seed >> 24), static_cast<std::uint8_t>(seed >> 16), static_cast<std::uint8_t>(seed >> 8)};
+    }
+    for (int f = 0; f < 12; ++f) {
+        for (size_t i = 0; i < frame.size(); ++i) {
+            if (i % 5 == static_cast<size_t>(f % 5)) {
+                frame[i].glyph = frame[i].glyph == '.' ? ':' : '.';
+            }
+            frame[i].r++;
+            frame[i].g++;
+            frame[i].b++;
+        }
+        video.push_back(frame);
+    }
+    
+    compressASCIIVideo(video, "test_spatial_colour.bin");
+    EncoderOptions options;
+    options.temporalColour = true;
+    compressASCIIVideo(video, "test_temporal_colour.bin", options);
+    ASCIIVideo decompressed = decompressASCIIVideo("test_temporal_colour.bin");
+    
+    // Verify
+    const auto spatialSize = fs::file_size("test_spatial_colour.bin");
+    const auto temporalSize = fs::file_size("test_temporal_colour.bin");
+    std::println("Spatial: {} bytes, temporal: {} bytes", spatialSize, temporalSize);
+    if (compareVideos(video, decompressed) && temporalSize < spatialSize) {
+        std::println("Test 17 PASSED: Temporal colour residuals decoded correctly and saved space!");
+    } else {
+        std::println("Test 17 FAILED: Temporal colour residuals were wrong or larger!");
+    }
+}
+
+// Test Case 18: rANS coding of skewed symbols, smaller than Huffman
+void testRansCoder() {
+    std::println("\n=== Test 18: rANS Coder ===");
+    
+    // Mostly blank gradient glyphs, so Huffman spends a whole bit where the
+    // entropy is well under one
+    const std::string gradient = "@%#*+=-:. ";
+    ASCIIVideo video(80, 30);
+    std::uint32_t seed = 7;
+    ASCIIFrame frame(80, 30);
+    for (int f = 0; f < 20; ++f) {
+        for (Cell& cell : frame.cells) {
+            seed = seed * 1664525u + 1013904223u;
+            if ((seed >> 28) < 3 || f == 0) {
+                const std::uint32_t pick = (seed >> 8) % 100;
+                cell.glyph = pick < 85 ? ' ' : gradient[pick % gradient.size()];
+                cell.r = cell.g = cell.b = static_cast<std::uint8_t>(cell.glyph == ' ' ? 0 : 200 + pick % 8);
+            }
+        }
+        video.push_back(frame);
+    }
+    
+    EncoderOptions options{10, 10};
+    compressASCIIVideo(video, "test_huffman_coder.bin", options);
+    options.entropyCoder = EntropyCoder::Rans;
+    compressASCIIVideo(video, "test_rans_coder.bin", options);
+    options.temporalColour = true;
+    compressASCIIVideo(video, "test_rans_temporal.bin", options);
+    
+    ASCIIVideo decompressed = decompressASCIIVideo("test_rans_coder.bin", 0, -1, 1);
+    ASCIIVideo temporal = decompressASCIIVideo("test_rans_temporal.bin", 0, -1, 1);
+    ASCIIVideo parallel = decompressASCIIVideo("test_rans_coder.bin", 0, -1, 3);
+    ASCIIVideoDecoder decoder(false);
+    bool seekOk = decoder.open("test_rans_coder.bin") && decoder.seek(13) && decoder.next() && decoder.frame() == video[13];
+    
+    // Verify
+    const auto huffmanSize = fs::file_size("test_huffman_coder.bin");
+    const auto ransSize = fs::file_size("test_rans_coder.bin");
+    std::println("Huffman: {} bytes, rANS: {} bytes", huffmanSize, ransSize);
+    if (compareVideos(video, decompressed) && compareVideos(video, temporal) && compareVideos(video, parallel) &&
+        seekOk && ransSize < huffmanSize) {
+        std::println("Test 18 PASSED: rANS streams decoded correctly and beat Huffman!");
+    } else {
+        std::println("Test 18 FAILED: rANS streams were wrong or larger than Huffman!");
+    }
+}
+
+// Test Case 19: A new table mid-segment when the statistics drift
+void testTableDrift() {
+    std::println("\n=== Test 19: Table Drift ===");
+    
+    // A dark scene cut to a bright one inside a single segment, with every
+    // cell redrawn each frame
+    const std::string dark = " .:";
+    const std::string bright = "@%#";
+    ASCIIVideo video(48, 16);
+    std::uint32_t seed = 3;
+    for (int f = 0; f < 24; ++f) {
+        const std::string& glyphs = f < 12 ? dark : bright;
+        ASCIIFrame frame(48, 16);
+        for (Cell& cell : frame.cells) {
+            seed = seed * 1664525u + 1013904223u;
+            const char glyph = glyphs[(seed >> 24) % glyphs.size()];
+            const std::uint8_t level = static_cast<std::uint8_t>(f < 12 ? 20 + (seed >> 12) % 4 : 230 + (seed >> 12) % 4);
+            cell = {glyph, level, level, level};
+        }
+        video.push_back(frame);
+    }
+    
+    // Without a scene cut key frame, so the drift check finds the cut
+    EncoderOptions options{64, 0};
+    options.adaptiveKeyFrames = false;
+    options.tableDrift = 0;
+    compressASCIIVideo(video, "test_single_table.bin", options);
+    options.tableDrift = 0.1;
+    compressASCIIVideo(video, "test_drift_tables.bin", options);
+    ASCIIVideo decompressed = decompressASCIIVideo("test_drift_tables.bin");
+    ASCIIVideoDecoder decoder(false);
+    bool seekOk = decoder.open("test_drift_tables.bin") && decoder.seek(17) && decoder.next() && decoder.frame() == video[17];
+    
+    // Verify
+    const auto singleSize = fs::file_size("test_single_table.bin");
+    const auto driftSize = fs::file_size("test_drift_tables.bin");
+    std::println("One table: {} bytes, drift tables: {} bytes", singleSize, driftSize);
+    if (compareVideos(video, decompressed) && seekOk && driftSize < singleSize) {
+        std::println("Test 19 PASSED: New tables at the scene cut decoded correctly and saved space!");
+    } else {
+        std::println("Test 19 FAILED: Drift tables were wrong or larger!");
+    }
+}
+
+// Test Case 20: Cells repeated within a frame coded as palette slots
+void testPalette() {
+    std::println("\n=== Test 20: Cell Palette ===");
+    
+    // Flat-shaded bands of a few (glyph, colour) pairs that slide each frame,
+    // like cel-shaded animation
+    const std::array<Cell, 5> shades{{
+        {' ', 10, 10, 30}, {'.', 40, 60, 120}, {'+', 200, 120, 40}, {'#', 250, 220, 180}, {'@', 255, 255, 255}}};
+    ASCIIVideo video(64, 24);
+    for (int f = 0; f < 16; ++f) {
+        ASCIIFrame frame(64, 24);
+        for (int y = 0; y < frame.height; ++y) {
+            for (int x = 0; x < frame.width; ++x) {
+                const int dx = x - 32 - f, dy = 2 * (y - 12);
+                frame.at(x, y) = shades[((dx * dx + dy * dy) / 90 + (x + f) / 7) % shades.size()];
+            }
+        }
+        video.push_back(frame);
+    }
+    
+    EncoderOptions options{8, 8};
+    compressASCIIVideo(video, "test_no_palette.bin", options);
+    options.palette = true;
+    compressASCIIVideo(video, "test_palette.bin", options);
+    options.temporalColour = true;
+    options.entropyCoder = EntropyCoder::Rans;
+    compressASCIIVideo(video, "test_palette_rans.bin", options);
+    ASCIIVideo decompressed = decompressASCIIVideo("test_palette.bin");
+    ASCIIVideo decompressedRans = decompressASCIIVideo("test_palette_rans.bin");
+    
+    // Verify
+    const auto plainSize = fs::file_size("test_no_palette.bin");
+    const auto paletteSize = fs::file_size("test_palette.bin");
+    std::println("Without palette: {} bytes, with palette: {} bytes", plainSize, paletteSize);
+    if (compareVideos(video, decompressed) && compareVideos(video, decompressedRans) && paletteSize < plainSize) {
+        std::println("Test 20 PASSED: Palette cells decoded correctly and saved space!");
+    } else {
+        std::println("Test 20 FAILED: Palette cells were wrong or larger!");
+    }
+}
+
+// Test Case 21: Lossy deltas with bounded, non-accumulating error
+void testLossyDeltas() {
+    std::println("\n=== Test 21: Lossy Deltas ===");
+    
+    // Colours drifting up one step every other frame under +-2 of noise, so
+    // every cell changes in every frame
+    ASCIIVideo video(48, 16);
+    std::uint32_t seed = 21;
+    for (int f = 0; f < 30; ++f) {
+        ASCIIFrame frame(48, 16);
+        for (std::size_t i = 0; i < frame.size(); ++i) {
+            seed = seed * 1664525u + 1013904223u;
+            const int noise = static_cast<int>((seed >> 24) % 5) - 2;
+            const auto level = static_cast<std::uint8_t>(100 + i % 50 + f / 2 + noise);
+            frame[i] = {i % 7 == 0 ? '#' : '+', level, level, static_cast<std::uint8_t>(level / 2)};
+        }
+        video.push_back(frame);
+    }
+    
+    EncoderOptions options{10, 10};
+    compressASCIIVideo(video, "test_lossless_noise.bin", options);
+    options.tolerance.channel = {4, 4, 4};
+    compressASCIIVideo(video, "test_lossy_noise.bin", options);
+    ASCIIVideo decompressed = decompressASCIIVideo("test_lossy_noise.bin");
+    
+    // Verify: glyphs exact and no channel ever further than the tolerance
+    bool withinTolerance = decompressed.size() == video.size();
+    for (size_t f = 0; withinTolerance && f < video.size(); ++f) {
+        for (size_t i = 0; i < video[f].size(); ++i) {
+            const Cell& a = video[f][i];
+            const Cell& b = decompressed[f][i];
+            withinTolerance = withinTolerance && a.glyph == b.glyph && std::abs(a.r - b.r) <= 4 &&
+                              std::abs(a.g - b.g) <= 4 && std::abs(a.b - b.b) <= 4;
+        }
+    }
+    const auto losslessSize = fs::file_size("test_lossless_noise.bin");
+    const auto lossySize = fs::file_size("test_lossy_noise.bin");
+    std::println("Lossless: {} bytes, lossy: {} bytes", losslessSize, lossySize);
+    if (withinTolerance && lossySize * 2 < losslessSize) {
+        std::println("Test 21 PASSED: Lossy deltas stayed within tolerance and halved the size!");
+    } else {
+        std::println("Test 21 FAILED: Lossy deltas drifted or did not save enough!");
+    }
+}
+
+// Test Case 22: Decoding from a memory-mapped file and rejecting truncated ones
+void testMappedReader() {
+    std::println("\n=== Test 22: Mapped Reader ===");
+    
+    ASCIIVideo video(24, 8);
+    for (int f = 0; f < 12; ++f) {
+        ASCIIFrame frame(24, 8);
+        for (size_t i = 0; i < frame.size(); ++i) {
+            frame[i] = {static_cast<char>('a' + (i + f) % 20), static_cast<std::uint8_t>(i), static_cast<std::uint8_t>(f), 7};
+        }
+        video.push_back(frame);
+    }
+    compressASCIIVideo(video, "test_mapped.bin", EncoderOptions{4, 4});
+    
+    MappedFile file;
+    const bool mapped = file.open("test_mapped.bin") && file.isMapped();
+    std::vector<std::uint8_t> bytes(file.bytes().begin(), file.bytes().end());
+    file.close();
+    ASCIIVideo decompressed = decompressASCIIVideo("test_mapped.bin");
+    
+    // Every truncation must fail cleanly rather than read past the mapping
+    bool truncatedOk = true;
+    for (size_t size = 0; size < bytes.size(); size += 7) {
+        {
+            std::ofstream out("test_truncated.bin", std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(size));
+        }
+        ASCIIVideo partial = decompressASCIIVideo("test_truncated.bin", 0, -1, 1);
+        truncatedOk = truncatedOk && partial.empty();
+    }
+    
+    // v1 trees with a flag byte that is neither 0 nor 1, or nested deeper
+    // than any 256-symbol tree, are rejected
+    bool treeOk = true;
+    for (const std::string& tree : {std::string("\2"), std::string(300, '\0')}) {
+        {
+            std::ofstream out("test_bad_tree.bin", std::ios::binary | std::ios::trunc);
+            const int frames = 1;
+            out.write(reinterpret_cast<const char*>(&frames), sizeof(frames));
+            out.write(tree.data(), static_cast<std::streamsize>(tree.size()));
+        }
+        treeOk = treeOk && decompressASCIIVideo("test_bad_tree.bin", 0, -1, 1).empty();
+    }
+    
+    // Pipes cannot be mapped and are read into memory instead
+    bool pipeOk = true;
+#ifndef _WIN32
+    fs::remove("test_pipe.bin");
+    if (::mkfifo("test_pipe.bin", 0600) == 0) {
+        std::thread writer([&] {
+            std::ofstream out("test_pipe.bin", std::ios::binary);
+            out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+        });
+        ASCIIVideoDecoder decoder(false);
+        pipeOk = decoder.open("test_pipe.bin");
+        for (size_t f = 0; pipeOk && f < video.size(); ++f) {
+            pipeOk = decoder.next() && decoder.frame() == video[f];
+        }
+        writer.join();
+        fs::remove("test_pipe.bin");
+    }
+#endif
+    
+    // Verify
+    if (mapped && compareVideos(video, decompressed) && truncatedOk && treeOk && pipeOk) {
+        std::println("Test 22 PASSED: Mapped, truncated and piped files read correctly!");
+    } else {
+        std::println("Test 22 FAILED: mapped {}, truncated {}, tree {}, pipe {}", mapped, truncatedOk, treeOk, pipeOk);
+    }
+}
+
+// Test Case 23: Grid size and frame rate in the file header
+void testHeaderGeometry() {
+    std::println("\n=== Test 23: Header Geometry ===");
+    
+    ASCIIVideo video(30, 10);
+    for (int f = 0; f < 9; ++f) {
+        ASCIIFrame frame(30, 10);
+        for (size_t i = 0; i < frame.size(); ++i) {
+            frame[i] = {i % 3 == static_cast<size_t>(f % 3) ? '#' : '.', 90, 90, 90};
+        }
+        video.push_back(frame);
+    }
+    EncoderOptions options{4, 4};
+    options.fps = 29.97f;
+    compressASCIIVideo(video, "test_header.bin", options);
+    
+    // The grid and frame rate are known before any frame is decoded
+    ASCIIVideoDecoder decoder(false);
+    const bool opened = decoder.open("test_header.bin");
+    const bool headerOk = opened && decoder.width() == 30 && decoder.height() == 10 &&
+                          decoder.framesPerSecond() == 29.97f && decoder.frameCount() == 9;
+    const bool seekOk = opened && decoder.seek(4) && decoder.next() && decoder.frame() == video[4];
+    ASCIIVideo decompressed = decompressASCIIVideo("test_header.bin");
+    
+    // A flipped high bit in the column count, and a v3 key frame claiming a
+    // 65536 x 65536 grid, are rejected before the grid is allocated
+    std::string bytes;
+    {
+        std::ifstream in("test_header.bin", std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(in), {});
+    }
+    const int columns = 30 | 1 << 30;
+    std::memcpy(bytes.data() + 13, &columns, sizeof(columns));
+    {
+        std::ofstream out("test_bad_header.bin", std::ios::binary | std::ios::trunc);
+        out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    }
+    largestAllocation = 0;
+    bool corruptOk = decompressASCIIVideo("test_bad_header.bin", 0, -1, 1).empty();
+    {
+        std::ofstream out("test_bad_header.bin", std::ios::binary | std::ios::trunc);
+        writeValue(out, kFileMagic);
+        writeValue(out, std::uint16_t{3});
+        writeValue(out, std::uint16_t{0});
+        writeValue(out, 1);
+        writeCodeLengths(out, CodeLengths{});
+        writeValue(out, FrameType::Key);
+        writeValue(out, 1 << 16);
+        writeValue(out, 1 << 16);
+        writeValue(out, 8);
+        writeValue(out, std::uint8_t{0});
+    }
+    corruptOk = corruptOk && decompressASCIIVideo("test_bad_header.bin", 0, -1, 1).empty() &&
+                largestAllocation < (std::size_t{1} << 20);
+    
+    // Verify
+    if (headerOk && seekOk && compareVideos(video, decompressed) && corruptOk) {
+        std::println("Test 23 PASSED: Header carries the grid size and frame rate!");
+    } else {
+        std::println("Test 23 FAILED: Header geometry was wrong!");
+    }
+}
+
+// Test Case 24: Delta positions coded as a tile map
+void testTileMaps() {
+    std::println("\n=== Test 24: Tile Maps ===");
+    
+    // A patch of flickering cells on a still background: isolated changes that
+    // runs code cell by cell but a few tile masks cover
+    ASCIIVideo video(40, 20);
+    for (int f = 0; f < 10; ++f) {
+        ASCIIFrame frame(40, 20);
+        for (int y = 0; y < 20; ++y) {
+            for (int x = 0; x < 40; ++x) {
+                const bool flicker = x >= 13 && x < 25 && y >= 5 && y < 17 && (x + y) % 2 == 0 && f % 2 == 0;
+                frame.at(x, y) = flicker ? Cell{'*', 255, 200, 0} : Cell{'.', 20, 20, static_cast<std::uint8_t>(x)};
+            }
+        }
+        video.push_back(frame);
+    }
+    compressASCIIVideo(video, "test_tiles.bin", EncoderOptions{5, 5});
+    ASCIIVideo decompressed = decompressASCIIVideo("test_tiles.bin");
+    
+    // The delta does not pan, and picks the tile map over runs
+    SymbolCounter counter;
+    const int changes = writeFrameCells(counter, video[1], true, video[0], CellCoding{}, choosePan(video[1], video[0]));
+    BitReader bits(counter.raw().finish(), static_cast<int>(counter.raw().bitCount()));
+    const bool tileMapOk = changes == 72 && bits.readBits(1) == 0 && bits.readBits(1) == 1;
+    
+    // The map agrees with a compare per cell, for clean rows and partial
+    // edge tiles too
+    bool mapsAgree = true;
+    std::uint32_t seed = 24;
+    ASCIIFrame a(37, 13), b(37, 13);
+    for (size_t i = 0; i < a.size(); ++i) {
+        seed = seed * 1664525u + 1013904223u;
+        a[i] = {'x', static_cast<std::uint8_t>(seed >> 24), 1, 2};
+        const bool cleanRow = i / 37 % 3 == 0;
+        b[i] = !cleanRow && (seed >> 8) % 5 == 0 ? Cell{'x', static_cast<std::uint8_t>((seed >> 24) + 1), 1, 2} : a[i];
+    }
+    const ChangeMap map(a, b);
+    std::vector<std::uint16_t> tiles(map.tiles.size());
+    for (size_t i = 0; i < a.size(); ++i) {
+        const int x = static_cast<int>(i % 37), y = static_cast<int>(i / 37);
+        if (a[i] != b[i]) {
+            tiles[(y / kTileSize) * map.tilesX + x / kTileSize] |= static_cast<std::uint16_t>(1 << (y % kTileSize * kTileSize + x % kTileSize));
+        }
+        mapsAgree = mapsAgree && map.changed(i) == (a[i] != b[i]);
+    }
+    mapsAgree = mapsAgree && map.tiles == tiles;
+    
+    // Verify
+    if (compareVideos(video, decompressed) && tileMapOk && mapsAgree) {
+        std::println("Test 24 PASSED: Tile map deltas decoded correctly!");
+    } else {
+        std::println("Test 24 FAILED: tile map {}, maps agree {}", tileMapOk, mapsAgree);
+    }
+}
+
+// Test Case 25: Panning deltas coded against a shifted previous frame
+void testPans() {
+    std::println("\n=== Test 25: Pans ===");
+    
+    // A camera moving right two cells a frame and down one every third frame
+    // over a textured scene, so nearly every cell changes in place
+    const auto scene = [](int x, int y) {
+        const std::uint32_t h = static_cast<std::uint32_t>(x) * 73856093u ^ static_cast<std::uint32_t>(y) * 19349663u;
+        return Cell{static_cast<char>('A' + h % 26), static_cast<std::uint8_t>(h >> 8), static_cast<std::uint8_t>(h >> 16), 40};
+    };
+    ASCIIVideo video(60, 20);
+    for (int f = 0; f < 12; ++f) {
+        ASCIIFrame frame(60, 20);
+        for (int y = 0; y < 20; ++y) {
+            for (int x = 0; x < 60; ++x) {
+                frame.at(x, y) = scene(x + 2 * f, y + f / 3);
+            }
+        }
+        video.push_back(frame);
+    }
+    compressASCIIVideo(video, "test_pans.bin", EncoderOptions{6, 6});
+    ASCIIVideo decompressed = decompressASCIIVideo("test_pans.bin");
+    
+    // A pan leaves only the uncovered edge to code: two columns, or two
+    // columns and a row when the camera also moves down
+    SymbolCounter counter;
+    const bool panOk = choosePan(video[1], video[0]) == std::pair{-2, 0} &&
+                       writeFrameCells(counter, video[1], true, video[0], CellCoding{}, {-2, 0}) == 2 * 20 &&
+                       writeFrameCells(counter, video[3], true, video[2], CellCoding{}, choosePan(video[3], video[2])) ==
+                           2 * 20 + 58;
+    
+    // Panned frames are reported as redrawing every cell
+    ASCIIVideoDecoder decoder(false);
+    bool keyOk = decoder.open("test_pans.bin") && decoder.next();
+    for (size_t f = 1; keyOk && f < video.size(); ++f) {
+        keyOk = decoder.next() && decoder.frame() == video[f] && decoder.keyFrame();
+    }
+    
+    // Shifting in place matches moving each cell
+    ASCIIFrame grid(7, 5);
+    for (size_t i = 0; i < grid.size(); ++i) {
+        grid[i] = {static_cast<char>('a' + i % 26), static_cast<std::uint8_t>(i), 0, 0};
+    }
+    bool shiftOk = true;
+    for (const auto& [dx, dy] : {std::pair{2, 1}, std::pair{-3, 0}, std::pair{0, -2}, std::pair{-1, 3}}) {
+        ASCIIFrame moved = grid;
+        shiftCells(moved.cells, moved.width, dx, dy);
+        for (int y = 0; y < grid.height; ++y) {
+            for (int x = 0; x < grid.width; ++x) {
+                const bool inside = x - dx >= 0 && x - dx < grid.width && y - dy >= 0 && y - dy < grid.height;
+                shiftOk = shiftOk && moved.at(x, y) == (inside ? grid.at(x - dx, y - dy) : grid.at(x, y));
+            }
+        }
+    }
+    
+    // Verify
+    const auto size = fs::file_size("test_pans.bin");
+    std::println("Panned video: {} bytes", size);
+    if (compareVideos(video, decompressed) && panOk && keyOk && shiftOk) {
+        std::println("Test 25 PASSED: Pans decoded correctly and coded only the uncovered edge!");
+    } else {
+        std::println("Test 25 FAILED: pan {}, key {}, shift {}", panOk, keyOk, shiftOk);
+    }
+}
+
+// Test Case 26: Key frames chosen by cost and at scene cuts
+void testAdaptiveKeyFrames() {
+    std::println("\n=== Test 26: Adaptive Key Frames ===");
+    
+    // Three shots of ten frames, with a block drifting inside each, cut
+    // dark / bright / dark. Frame 5 is a flash of noise in the dark glyphs.
+    const auto shot = [](int scene, int f, int x, int y) {
+        const std::string glyphs = scene == 1 ? "@%#" : " .:";
+        const bool block = x >= f % 10 && x < f % 10 + 6 && y >= 3 && y < 7;
+        const auto level = static_cast<std::uint8_t>(scene == 1 ? 220 : 30 + scene * 10);
+        return block ? Cell{'X', 255, 0, 0} : Cell{glyphs[(x * 7 + y * 3) % 3], level, level, static_cast<std::uint8_t>(x)};
+    };
+    ASCIIVideo video(40, 12);
+    std::uint32_t seed = 26;
+    for (int f = 0; f < 30; ++f) {
+        ASCIIFrame frame(40, 12);
+        for (int y = 0; y < 12; ++y) {
+            for (int x = 0; x < 40; ++x) {
+                seed = seed * 1664525u + 1013904223u;
+                frame.at(x, y) = f == 5 ? Cell{" .:"[(seed >> 24) % 3], static_cast<std::uint8_t>(seed >> 8), 30, 30}
+                                        : shot(f / 10, f, x, y);
+            }
+        }
+        video.push_back(frame);
+    }
+    EncoderOptions options{64, 0};
+    options.referenceFrames = false;
+    compressASCIIVideo(video, "test_adaptive_keys.bin", options);
+    options.adaptiveKeyFrames = false;
+    compressASCIIVideo(video, "test_fixed_keys.bin", options);
+    ASCIIVideo decompressed = decompressASCIIVideo("test_adaptive_keys.bin");
+    
+    // The cuts are seek points; the flash and the frame after it are key
+    // frames inside their segment
+    ASCIIVideoDecoder decoder(false);
+    bool opened = decoder.open("test_adaptive_keys.bin");
+    std::vector<int> seekFrames;
+    for (const SeekEntry& entry : decoder.keyFrames()) {
+        seekFrames.push_back(entry.frame);
+    }
+    std::vector<int> keyFrames;
+    for (int f = 0; opened && decoder.next(); ++f) {
+        if (decoder.keyFrame()) {
+            keyFrames.push_back(f);
+        }
+    }
+    const bool seekOk = opened && decoder.seek(20) && decoder.next() && decoder.frame() == video[20];
+    
+    // Verify
+    const auto adaptiveSize = fs::file_size("test_adaptive_keys.bin");
+    const auto fixedSize = fs::file_size("test_fixed_keys.bin");
+    std::println("Fixed keys: {} bytes, adaptive keys: {} bytes", fixedSize, adaptiveSize);
+    if (compareVideos(video, decompressed) && seekFrames == std::vector<int>{0, 10, 20} &&
+        keyFrames == std::vector<int>{0, 5, 6, 10, 20} && seekOk && adaptiveSize <= fixedSize) {
+        std::println("Test 26 PASSED: Scene cuts and costly deltas became key frames!");
+    } else {
+        std::println("Test 26 FAILED: seek points {}, key frames {}", seekFrames, keyFrames);
+    }
+}
+
+// Test Case 27: Returning shots coded against reference slots
+void testReferenceFrames() {
+    std::println("\n=== Test 27: Reference Frames ===");
+    
+    // A six-frame loop of unrelated noise frames played ten times, so every
+    // frame differs from the one before it but repeats one seen earlier
+    ASCIIVideo loop(32, 12);
+    std::uint32_t seed = 27;
+    for (int f = 0; f < 6; ++f) {
+        ASCIIFrame frame(32, 12);
+        for (Cell& cell : frame.cells) {
+            seed = seed * 1664525u + 1013904223u;
+            cell = {"#*+=-"[(seed >> 24) % 5], static_cast<std::uint8_t>(seed >> 8), static_cast<std::uint8_t>(seed >> 16), 90};
+        }
+        loop.push_back(frame);
+    }
+    ASCIIVideo video(32, 12);
+    for (int f = 0; f < 60; ++f) {
+        video.push_back(loop[f % 6]);
+    }
+    EncoderOptions options{32, 32};
+    compressASCIIVideo(video, "test_references.bin", options);
+    options.referenceFrames = false;
+    compressASCIIVideo(video, "test_no_references.bin", options);
+    ASCIIVideo decompressed = decompressASCIIVideo("test_references.bin", 0, -1, 1);
+    ASCIIVideo parallel = decompressASCIIVideo("test_references.bin", 0, -1, 2);
+    
+    // Seeking past the second seek point finds its slots refilled
+    ASCIIVideoDecoder decoder(false);
+    const bool seekOk = decoder.open("test_references.bin") && decoder.seek(50) && decoder.next() &&
+                        decoder.frame() == video[50] && decoder.seek(7) && decoder.next() && decoder.frame() == video[7];
+    
+    // Verify
+    const auto withSize = fs::file_size("test_references.bin");
+    const auto withoutSize = fs::file_size("test_no_references.bin");
+    std::println("Without references: {} bytes, with: {} bytes", withoutSize, withSize);
+    if (compareVideos(video, decompressed) && compareVideos(video, parallel) && seekOk && withSize * 3 < withoutSize) {
+        std::println("Test 27 PASSED: Repeated frames were coded against reference slots!");
+    } else {
+        std::println("Test 27 FAILED: Reference frames were wrong or too large!");
+    }
+}
+
+// Test Case 28: Steady-state decode into a caller buffer allocates nothing
+void testZeroAllocationDecode() {
+    std::println("\n=== Test 28: Zero-Allocation Decode ===");
+    
+    // A block moving over a still background, a noise flash, a pan and a
+    // return to the opening shot, so every kind of record is decoded
+    ASCIIVideo video(48, 16);
+    std::uint32_t seed = 28;
+    for (int f = 0; f < 80; ++f) {
+        ASCIIFrame frame(48, 16);
+        for (int y = 0; y < 16; ++y) {
+            for (int x = 0; x < 48; ++x) {
+                seed = seed * 1664525u + 1013904223u;
+                const int shot = f % 40 < 20 ? 0 : f % 40 - 19;
+                const bool block = x >= f % 20 && x < f % 20 + 5 && y >= 4 && y < 8;
+                frame.at(x, y) = f % 40 == 10 ? Cell{"+-"[(seed >> 24) % 2], static_cast<std::uint8_t>(seed >> 8), 9, 9}
+                                 : block      ? Cell{'#', 250, 250, 250}
+                                              : Cell{" .:"[(x + shot + y * 2) % 3], static_cast<std::uint8_t>(x + shot), 40, 80};
+            }
+        }
+        video.push_back(frame);
+    }
+    
+    bool framesOk = true;
+    bool allocationsOk = true;
+    for (const EntropyCoder coder : {EntropyCoder::Huffman, EntropyCoder::Rans}) {
+        EncoderOptions options{16, 32};
+        options.entropyCoder = coder;
+        options.temporalColour = true;
+        options.palette = true;
+        compressASCIIVideo(video, "test_zero_alloc.bin", options);
+        
+        // The first pass lets tables and scratch buffers reach their size;
+        // the second must not allocate at all
+        ASCIIVideoDecoder decoder(false);
+        framesOk = framesOk && decoder.open("test_zero_alloc.bin");
+        std::vector<Cell> cells(video.cellsPerFrame());
+        std::vector<std::uint32_t> changed;
+        std::size_t allocations = 0;
+        for (int pass = 0; framesOk && pass < 2; ++pass) {
+            framesOk = decoder.seek(0);
+            const std::size_t before = allocationCount;
+            for (size_t f = 0; framesOk && f < video.size(); ++f) {
+                framesOk = decoder.next(cells, changed) && std::ranges::equal(cells, video[f].cells);
+            }
+            allocations = allocationCount - before;
+        }
+        std::println("{} steady-state allocations: {}", coder == EntropyCoder::Rans ? "rANS" : "Huffman", allocations);
+        allocationsOk = allocationsOk && allocations == 0;
+    }
+    
+    // Verify
+    if (framesOk && allocationsOk) {
+        std::println("Test 28 PASSED: Frames decoded into a caller buffer without allocating!");
+    } else {
+        std::println("Test 28 FAILED: frames {}, no allocations {}", framesOk, allocationsOk);
+    }
+}
+
+// Test Case 29: Huffman payloads split into raw, colour and glyph lane streams
+void testSplitStreams() {
+    std::println("\n=== Test 29: Split Huffman Streams ===");
+    
+    // Glyphs with a geometric distribution, so the rarest get codes longer
+    // than the decoder's lookup table
+    std::array<HuffmanCodeTable, kContextCount> codes{};
+    SymbolCounts counts{};
+    for (int symbol = 0; symbol < 20; ++symbol) {
+        counts['A' + symbol] = 1 << (19 - symbol);
+        counts[symbol] = 1;
+    }
+    codes[kGlyphContext] = buildCanonicalCodes(buildCodeLengths(counts));
+    codes[kColourContext] = codes[kGlyphContext];
+    std::array<HuffmanDecoder, kContextCount> decoders;
+    decoders[kGlyphContext].assign(codes[kGlyphContext]);
+    decoders[kColourContext].assign(codes[kColourContext]);
+    
+    // 50 glyphs, every fifth followed by a colour symbol and a raw bit
+    HuffmanSymbolWriter writer(codes);
+    std::array<int, kHuffmanStreams> expectedBits{};
+    std::vector<std::uint8_t> symbols;
+    for (int i = 0; i < 50; ++i) {
+        const auto glyph = static_cast<std::uint8_t>('A' + (i * 7 % 20));
+        writer.put(kGlyphContext, glyph);
+        expectedBits[1 + i % kGlyphLanes] += codes[kGlyphContext][glyph].length;
+        symbols.push_back(glyph);
+        if (i % 5 == 0) {
+            writer.put(kColourContext, 'B');
+            writer.raw().writeBits(1, 1);
+            expectedBits[0] += codes[kColourContext]['B'].length;
+        }
+    }
+    std::stringstream payload;
+    writer.writeTo(payload);
+    
+    // The raw bits, then the colour stream and each lane, byte aligned
+    const std::string bytes = payload.str();
+    ByteReader in(std::span(reinterpret_cast<const std::uint8_t*>(bytes.data()), bytes.size()));
+    int rawBits;
+    std::span<const std::uint8_t> rawBytes;
+    std::array<std::span<const std::uint8_t>, kHuffmanStreams> streamBytes;
+    std::array<int, kHuffmanStreams> streamBits{};
+    bool layoutOk = readValue(in, rawBits) && readBitStream(in, rawBits, rawBytes) && rawBits == 10;
+    for (int stream = 0; stream < kHuffmanStreams; ++stream) {
+        layoutOk = layoutOk && readValue(in, streamBits[stream]) &&
+                   readBitStream(in, streamBits[stream], streamBytes[stream]) &&
+                   streamBits[stream] == expectedBits[stream];
+    }
+    layoutOk = layoutOk && in.remaining() == 0;
+    
+    // Both with the glyphs decoded up front and read from the lanes on demand
+    bool readOk = layoutOk;
+    for (const int glyphCount : {50, -1}) {
+        std::vector<char> glyphs;
+        SplitHuffmanSymbolReader reader(decoders, rawBytes, rawBits, streamBytes, streamBits, glyphs, glyphCount);
+        for (int i = 0; readOk && i < 50; ++i) {
+            readOk = reader.get(kGlyphContext) == symbols[i] &&
+                     (i % 5 != 0 || (reader.get(kColourContext) == 'B' && reader.raw().readBits(1) == 1));
+        }
+        readOk = readOk && !reader.overrun();
+    }
+    
+    // Whole videos round trip through the lanes with and without palette
+    // slots, which leave the glyph count unknown until the frame is read
+    ASCIIVideo video(37, 9);
+    std::uint32_t seed = 29;
+    for (int f = 0; f < 12; ++f) {
+        ASCIIFrame frame(37, 9);
+        for (Cell& cell : frame.cells) {
+            seed = seed * 1664525u + 1013904223u;
+            const int rarity = std::countr_zero(seed | 1u << 16);
+            cell = f % 3 == 2 && seed % 4 != 0 ? video[f - 1][&cell - frame.cells.data()]
+                                                : Cell{static_cast<char>('A' + rarity), static_cast<std::uint8_t>(rarity * 9), 40, 200};
+        }
+        video.push_back(frame);
+    }
+    bool roundTripOk = true;
+    for (const bool palette : {false, true}) {
+        EncoderOptions options{6, 6};
+        options.palette = palette;
+        options.temporalColour = palette;
+        compressASCIIVideo(video, "test_split_streams.bin", options);
+        roundTripOk = roundTripOk && compareVideos(video, decompressASCIIVideo("test_split_streams.bin", 0, -1, 1));
+    }
+    
+    // Verify
+    if (layoutOk && readOk && roundTripOk) {
+        std::println("Test 29 PASSED: Glyph, colour and raw streams split and read back!");
+    } else {
+        std::println("Test 29 FAILED: layout {}, reads {}, round trip {}", layoutOk, readOk, roundTripOk);
+    }
+}
+
+// Test Case 30: Keys chosen for size are not seek points
+void testKeySeekPoints() {
+    std::println("\n=== Test 30: Key Frames Without Seek Points ===");
+    
+    // A noise shot, the same cells reversed, which share its histogram and
+    // so are coded as keys without being scene cuts, then the first again,
+    // repeated between seek points every eight frames
+    ASCIIFrame first(32, 12);
+    std::uint32_t seed = 30;
+    for (Cell& cell : first.cells) {
+        seed = seed * 1664525u + 1013904223u;
+        cell = {"#*+=-"[(seed >> 24) % 5], static_cast<std::uint8_t>(seed >> 8), static_cast<std::uint8_t>(seed >> 16), 90};
+    }
+    ASCIIFrame reversed(32, 12, std::vector<Cell>(first.cells.rbegin(), first.cells.rend()));
+    ASCIIVideo video(32, 12);
+    for (int f = 0; f < 32; ++f) {
+        video.push_back(f % 8 < 4 || f % 8 >= 6 ? first : reversed);
+    }
+    EncoderOptions options{4, 8};
+    compressASCIIVideo(video, "test_key_seek_points.bin", options);
+    
+    // Seeking to the second segment of a group starts from the group's seek
+    // point, since its key is followed by a frame coded against the first
+    // shot's slot
+    ASCIIVideoDecoder decoder(false);
+    bool seekOk = decoder.open("test_key_seek_points.bin") && decoder.keyFrames().size() == 4;
+    for (int f : {5, 6, 13, 2, 29}) {
+        seekOk = seekOk && decoder.seek(f) && decoder.next() && decoder.frame() == video[f];
+    }
+    ASCIIVideo expected(32, 12);
+    for (size_t f = 5; f < video.size(); ++f) {
+        expected.push_back(video[f]);
+    }
+    ASCIIVideo range = decompressASCIIVideo("test_key_seek_points.bin", 5, -1, 1);
+    
+    // Three whole groups follow frame 5, so the threads each restore slots
+    // from their own group's Keep records
+    ASCIIVideo parallel = decompressASCIIVideo("test_key_seek_points.bin", 5, -1, 2);
+    
+    // Verify
+    if (seekOk && compareVideos(expected, range) && compareVideos(expected, parallel)) {
+        std::println("Test 30 PASSED: Seeks past size-chosen keys decoded from a seek point!");
+    } else {
+        std::println("Test 30 FAILED: Seeking past a size-chosen key was wrong!");
+    }
+}
+
 int main() {
     std::println("Starting Codec Tests...\n");
     
@@ -239,6 +1500,31 @@ int main() {
         testLargeFrame();
         testSingleFrame();
         testCompleteChange();
+        testSkewedAlphabet();
+        testLengthLimitedCodes();
+        testLegacyFile();
+        testFrameStore();
+        testStreamingEncoder();
+        testFrameDecoder();
+        testSeekIndex();
+        testParallelEncode();
+        testParallelDecode();
+        testDeltaRuns();
+        testColourCoding();
+        testTemporalColour();
+        testRansCoder();
+        testTableDrift();
+        testPalette();
+        testLossyDeltas();
+        testMappedReader();
+        testHeaderGeometry();
+        testTileMaps();
+        testPans();
+        testAdaptiveKeyFrames();
+        testReferenceFrames();
+        testZeroAllocationDecode();
+        testSplitStreams();
+        testKeySeekPoints();
         
         std::println("\n=== All Tests Complete ===");
         